@@ -0,0 +1,309 @@
+/*
+ * autotune.c - Search tile shapes, traversal orders and tile kernels of
+ *     the transpose for a given cache
+ *
+ * Every variant of tune_trans is run once in process through memtrace,
+ * the same model as test-trans -n, and ranked by misses. The best few
+ * are then timed with the -O2 build. For each matrix size the variant
+ * with the fewest misses, the fastest of its ties, is printed as a line
+ * that can be pasted into transpose_submit's case analysis; the
+ * registered functions in trans.c and xtrans.c are scored alongside as
+ * baselines.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include "cachelab.h"
+#include "memtrace.h"
+#include "tune.h"
+#include "xtrans.h"
+
+/* Maximum array dimension, as in test-trans */
+#define MAXN 256
+
+/* Most matrix sizes tuned in one run */
+#define MAXSIZES 16
+
+/* External function defined in trans.c */
+extern void registerFunctions();
+
+/* External variables defined in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+/* B right after A, like test-trans and tracegen */
+static struct {
+    int A[MAXN][MAXN];
+    int B[MAXN][MAXN];
+} mat;
+
+/* A scored variant */
+struct variant {
+    tune_t t;
+    unsigned int misses;
+    double ns;              /* per call, 0 if not timed */
+};
+
+/* Tile sides tried, for rows and columns independently */
+static const int sides[] = {1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 24, 32};
+#define NSIDES (int)(sizeof(sides) / sizeof(sides[0]))
+
+static const char *kernels[] = {"plain", "defer", "rowbuf", "split"};
+static const char *orders[] = {"rows", "cols"};
+
+/* Options */
+static unsigned int s = 5, E = 1, b = 5;
+static int top = 10, reps = 0, verbose = 0;
+
+/*
+ * check - return 1 if mat.B holds the transpose of mat.A
+ */
+static int check(int M, int N)
+{
+    int (*A)[M] = (int (*)[M])mat.A;
+    int (*B)[N] = (int (*)[N])mat.B;
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            if (A[i][j] != B[j][i])
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * simulate - run one variant, or registered function fn if t is NULL,
+ *     through the cache model and return its misses, or -1 if the
+ *     result is wrong
+ */
+static long simulate(int M, int N, const tune_t *t, int fn)
+{
+    unsigned int hits, misses, evictions;
+
+    initMatrix(M, N, mat.A, mat.B);
+    if (memtrace_start(s, E, b, &mat, &mat + 1) < 0) {
+        fprintf(stderr, "Error: can not allocate the cache model\n");
+        exit(1);
+    }
+    if (t != NULL)
+        tune_trans_traced(M, N, mat.A, mat.B, t);
+    else
+        (*func_list[fn].func_ptr)(M, N, mat.A, mat.B);
+    memtrace_stop(&hits, &misses, &evictions);
+    return check(M, N) ? (long)misses : -1;
+}
+
+/*
+ * timeit - nanoseconds per call of the -O2 build of variant t
+ */
+static double timeit(int M, int N, const tune_t *t)
+{
+    struct timespec start, end;
+    int r, n = reps;
+
+    /* default: about 16M elements, enough for stable times */
+    if (n <= 0)
+        n = (1 << 24) / (M * N) + 1;
+    tune_trans(M, N, mat.A, mat.B, t);  /* warm up */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < n; r++)
+        tune_trans(M, N, mat.A, mat.B, t);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 +
+            (end.tv_nsec - start.tv_nsec)) / n;
+}
+
+/*
+ * bymisses - qsort order of variants, fewest misses first, then the
+ *     timed ones fastest first
+ */
+static int bymisses(const void *x, const void *y)
+{
+    const struct variant *a = x, *b = y;
+
+    if (a->misses != b->misses)
+        return (a->misses > b->misses) - (a->misses < b->misses);
+    if ((a->ns > 0) != (b->ns > 0))
+        return (b->ns > 0) - (a->ns > 0);
+    return (a->ns > b->ns) - (a->ns < b->ns);
+}
+
+/*
+ * printvariant - one row of the results table
+ */
+static void printvariant(const struct variant *v)
+{
+    char tile[16];
+
+    sprintf(tile, "%dx%d", v->t.rows, v->t.cols);
+    printf("%-8s %-6s %-8s %-10u", tile, orders[v->t.order],
+           kernels[v->t.kernel], v->misses);
+    if (v->ns > 0)
+        printf(" %.0f", v->ns);
+    printf("\n");
+}
+
+/*
+ * tune - score every variant for an M x N matrix and keep the best
+ */
+static void tune(int M, int N, struct variant *best)
+{
+    struct variant *v;
+    int n = 0, i, j, o, k, timed;
+    long misses;
+
+    v = malloc(NSIDES * NSIDES * 2 * 4 * sizeof(struct variant));
+    if (v == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+
+    printf("\nM=%d N=%d, cache s=%u E=%u b=%u\n", M, N, s, E, b);
+    for (i = 0; i < func_counter; i++) {
+        misses = simulate(M, N, NULL, i);
+        if (misses < 0)
+            printf("registered func %d (%s): wrong result\n",
+                   i, func_list[i].description);
+        else
+            printf("registered func %d (%s): misses:%ld\n",
+                   i, func_list[i].description, misses);
+    }
+
+    for (i = 0; i < NSIDES; i++) {
+        for (j = 0; j < NSIDES; j++) {
+            for (o = TUNE_ROWS; o <= TUNE_COLS; o++) {
+                for (k = TUNE_PLAIN; k <= TUNE_SPLIT; k++) {
+                    tune_t t = {sides[i], sides[j], o, k};
+                    /* split only differs from rowbuf on square tiles */
+                    if (k == TUNE_SPLIT && (i != j || sides[i] % 2))
+                        continue;
+                    if ((misses = simulate(M, N, &t, -1)) < 0) {
+                        fprintf(stderr, "Error: %dx%d %s %s is wrong\n",
+                                t.rows, t.cols, orders[o], kernels[k]);
+                        exit(1);
+                    }
+                    v[n].t = t;
+                    v[n].misses = misses;
+                    v[n].ns = 0;
+                    n++;
+                }
+            }
+        }
+    }
+
+    /* time the best few by misses, then rank again */
+    qsort(v, n, sizeof(struct variant), bymisses);
+    timed = top < n ? top : n;
+    for (i = 0; i < timed; i++)
+        v[i].ns = timeit(M, N, &v[i].t);
+    qsort(v, timed, sizeof(struct variant), bymisses);
+
+    printf("%d variants, best %d by misses (ns per call on this machine):\n",
+           n, verbose ? n : timed);
+    printf("%-8s %-6s %-8s %-10s %s\n", "tile", "order", "kernel",
+           "misses", "ns");
+    for (i = 0; i < (verbose ? n : timed); i++)
+        printvariant(&v[i]);
+
+    *best = v[0];
+    free(v);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hv] [-s <s>] [-E <E>] [-b <b>] [-k <n>] [-r <reps>] [-d <MxN,...>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h           Print this help message.\n");
+    printf("  -v           List every variant, not only the best.\n");
+    printf("  -s <s>       Number of set index bits (default 5).\n");
+    printf("  -E <E>       Number of lines per set (default 1).\n");
+    printf("  -b <b>       Number of block offset bits (default 5).\n");
+    printf("  -k <n>       Variants timed, fewest misses first (default 10).\n");
+    printf("  -r <reps>    Calls per timing (default: about 16M elements).\n");
+    printf("  -d <MxN,...> Matrix sizes, M columns by N rows (max %d,\n", MAXN);
+    printf("               default 32x32,64x64,61x67).\n");
+    printf("Example: %s -s 6 -E 2 -b 6 -d 64x64\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char *sizes = "32x32,64x64,61x67", *p;
+    int dims[MAXSIZES][2], nsizes = 0, i;
+    struct variant best[MAXSIZES];
+    char c;
+
+    while ((c = getopt(argc, argv, "s:E:b:k:r:d:vh")) != -1) {
+        switch (c) {
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'k':
+            top = atoi(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'd':
+            sizes = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    for (p = sizes; *p && nsizes < MAXSIZES; nsizes++) {
+        int M = 0, N = 0, len = 0;
+        if (sscanf(p, "%dx%d%n", &M, &N, &len) != 2 || M < 1 || N < 1 ||
+            M > MAXN || N > MAXN) {
+            printf("Error: bad matrix size at \"%s\"\n", p);
+            usage(argv);
+            exit(1);
+        }
+        dims[nsizes][0] = M;
+        dims[nsizes][1] = N;
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    if (nsizes == 0 || E == 0 || s + b >= 32 || top < 1) {
+        printf("Error: Missing or wrong argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    registerFunctions();
+    registerExtraFunctions();
+    for (i = 0; i < nsizes; i++)
+        tune(dims[i][0], dims[i][1], &best[i]);
+
+    /* one line per size, the configuration to hand-code */
+    printf("\nBest per size for s=%u E=%u b=%u:\n", s, E, b);
+    printf("%-6s %-6s %-8s %-6s %-8s %-10s %s\n",
+           "M", "N", "tile", "order", "kernel", "misses", "ns");
+    for (i = 0; i < nsizes; i++) {
+        printf("%-6d %-6d ", dims[i][0], dims[i][1]);
+        printvariant(&best[i]);
+    }
+    return 0;
+}
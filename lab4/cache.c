@@ -0,0 +1,1356 @@
+/*
+ * cache.c - Cache simulator library, see cache.h
+ *
+ * Every level keeps its lines as flat arrays, one row of E tags per
+ * set, with the policy state and dirty bits in matching rows. A miss
+ * fetches from the level below, and an eviction may write back,
+ * invalidate the levels above (inclusive) or move the victim down
+ * (exclusive), so one access can ripple through the whole hierarchy.
+ * Prefetches take the same path as a miss, but are not counted as one,
+ * and the level remembers when each prefetched line arrived until it is
+ * used or evicted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "cache.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Tag stored in a line that holds no block, no address maps to it */
+#define INVALID_TAG ULONG_MAX
+
+/* Ways are compared this many at a time, rows are padded to a multiple */
+#if defined(__AVX2__)
+#define WAY_GROUP 4
+#elif defined(__SSE2__)
+#define WAY_GROUP 2
+#else
+#define WAY_GROUP 1
+#endif
+
+/* Next use of a block that is never used again */
+#define NEVER ULONG_MAX
+
+/* Re-reference prediction values of RRIP are 2 bits */
+#define RRPV_MAX 3
+
+/* Line value of a block that was seen but is not in the shadow */
+#define SEEN (ULONG_MAX - 1)
+
+/* End of the LRU list of a shadow */
+#define NIL ULONG_MAX
+
+/* Initial state of the xorshift generator of a level */
+#define SEED 0x2545f4914f6cdd1dUL
+
+/* Instructions the stride prefetcher tracks, a power of two */
+#define PF_TABLE 64
+
+/* Streams the stream prefetcher follows */
+#define PF_STREAMS 16
+
+/* Blocks apart two misses can be and still belong to one stream */
+#define PF_WINDOW 16
+
+static const char *prefetchername[] = {
+    "none", "nextline", "stride", "stream"
+};
+#define NPREFETCHER (sizeof(prefetchername) / sizeof(prefetchername[0]))
+
+static const char *policyname[] = {
+    "lru", "plru", "srrip", "brrip", "random", "fifo", "opt"
+};
+#define NPOLICY (sizeof(policyname) / sizeof(policyname[0]))
+
+/* Open addressing hash map from block number to a value */
+struct blockmap {
+    unsigned long mask;     /* capacity of key/val minus one */
+    unsigned long used;
+    unsigned long *key;
+    unsigned long *val;
+};
+
+/* Map from block number to the index of the next access of that block,
+ * kept up to date while simulating so OPT can look into the future */
+struct future {
+    unsigned int b;
+    struct blockmap map;
+    unsigned long *next;    /* next[k] is the next access after k to its block */
+};
+
+/* The lines of one level. `stamp` holds the LRU/FIFO time, the RRPV of
+ * RRIP, and is unused by PLRU, which keeps a bit tree per set in `tree`
+ * instead. Rows are `stride` long. */
+struct cache {
+    unsigned int s, E, b;
+    unsigned int stride;
+    enum cache_policy policy;
+    unsigned long *tag;
+    unsigned long *stamp;
+    unsigned long *tree;
+    unsigned char *dirty;
+    unsigned long clock;
+    unsigned long seed;     /* xorshift state for RANDOM and BRRIP */
+    unsigned long seed0;    /* its state when empty, see cache_seed */
+    struct future *future;  /* OPT only */
+    unsigned long *arrival; /* per line, when a prefetch filled it plus one,
+                               0 if not prefetched or already used; NULL
+                               without a prefetcher */
+    unsigned long latency;
+    unsigned long hits, misses, evictions, writebacks;
+    unsigned long prefetches, useful, late, useless, pending;
+};
+
+/* Last address and stride of one instruction */
+struct stride {
+    unsigned long pc, last;
+    long stride;
+    int confidence;         /* 0 to 3, prefetch from 2 */
+};
+
+/* A run of misses: the last block, the direction once two are seen, and
+ * the next block to prefetch */
+struct stream {
+    unsigned long block, next, used;
+    long dir;               /* 0 while training */
+    int valid;
+};
+
+/* The prefetcher of a level */
+struct prefetcher {
+    cache_prefetch_t cf;
+    struct stride table[PF_TABLE];
+    struct stream streams[PF_STREAMS];
+    unsigned long clock;
+};
+
+/* Fully associative LRU shadow of a level, used to classify its misses:
+ * compulsory misses are first touches, capacity misses also miss the
+ * shadow, and conflict misses are the rest */
+struct shadow {
+    unsigned long lines, used;
+    struct blockmap where;  /* block -> its line, or SEEN */
+    unsigned long *block;   /* block of each line */
+    unsigned long *prev, *next;
+    unsigned long head, tail;   /* most and least recently used line */
+    unsigned long count[3];
+    struct blockmap regions;    /* region -> index in region */
+    cache_region_t *region;
+    unsigned long nregion, maxregion;
+};
+
+/* One level of the hierarchy */
+struct level {
+    struct cache c;
+    enum cache_inclusion incl;
+    int writethrough;
+    struct shadow *shadow;  /* NULL unless misses are classified */
+    struct prefetcher *pf;  /* NULL without a prefetcher */
+};
+
+struct cachesim {
+    struct level lv[CACHE_MAXLEVEL];
+    int nlevels;
+    int regionbits;         /* -1 for no regions */
+    struct future futures[CACHE_MAXLEVEL];  /* one per block size of OPT */
+    int nfutures;
+    unsigned long *plan;    /* blocks given to cache_plan, for cache_reset */
+    unsigned long nplan, now;
+    unsigned long pc;       /* instruction of the current accesses */
+    int failed;             /* a shadow or future ran out of memory */
+};
+
+/*
+ * findway - return the way of the row holding tag, or -1 on a miss.
+ *     Compares WAY_GROUP tags per step; the padding ways hold
+ *     INVALID_TAG so they never match.
+ */
+static int findway(const unsigned long *row, unsigned int stride,
+                   unsigned long tag)
+{
+    unsigned int i;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi64x((long long)tag);
+    for (i = 0; i < stride; i += 4) {
+        __m256i ways = _mm256_loadu_si256((const __m256i *)(row + i));
+        int mask = _mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpeq_epi64(ways, key)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi64x((long long)tag);
+    for (i = 0; i < stride; i += 2) {
+        __m128i ways = _mm_loadu_si128((const __m128i *)(row + i));
+        /* SSE2 has no 64-bit compare, both 32-bit halves must match */
+        __m128i eq = _mm_cmpeq_epi32(ways, key);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2,3,0,1)));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#else
+    for (i = 0; i < stride; i++) {
+        if (row[i] == tag)
+            return i;
+    }
+#endif
+    return -1;
+}
+
+/*
+ * mapslot - return the slot of block in the map, or the empty slot
+ *     where it would go
+ */
+static unsigned long mapslot(struct blockmap *m, unsigned long block)
+{
+    unsigned long h = block * 0x9e3779b97f4a7c15UL;
+    unsigned long i = (h ^ h >> 29) & m->mask;
+
+    while (m->key[i] != block && m->key[i] != ULONG_MAX)
+        i = (i + 1) & m->mask;
+    return i;
+}
+
+/*
+ * mapget - return the value of block, or missing if it is not there
+ */
+static unsigned long mapget(struct blockmap *m, unsigned long block,
+                            unsigned long missing)
+{
+    unsigned long i;
+
+    if (m->key == NULL)
+        return missing;
+    i = mapslot(m, block);
+    return m->key[i] == ULONG_MAX ? missing : m->val[i];
+}
+
+/*
+ * mapput - set the value of block, doubling the map when it gets half
+ *     full. Returns 0, or -1 if it can not grow, leaving it as it was.
+ */
+static int mapput(struct blockmap *m, unsigned long block, unsigned long val)
+{
+    unsigned long i, j, *oldkey, *oldval, oldsize = m->mask + 1;
+
+    if (m->key == NULL || 2 * (m->used + 1) > oldsize) {
+        unsigned long size = m->key == NULL ? 1024 : 2 * oldsize;
+        unsigned long *key = malloc(size * sizeof(unsigned long));
+        unsigned long *v = malloc(size * sizeof(unsigned long));
+        if (key == NULL || v == NULL) {
+            free(key);
+            free(v);
+            return -1;
+        }
+        oldkey = m->key;
+        oldval = m->val;
+        m->key = key;
+        m->val = v;
+        m->mask = size - 1;
+        for (i = 0; i < size; i++)
+            m->key[i] = ULONG_MAX;
+        for (i = 0; oldkey != NULL && i < oldsize; i++) {
+            if (oldkey[i] != ULONG_MAX) {
+                j = mapslot(m, oldkey[i]);
+                m->key[j] = oldkey[i];
+                m->val[j] = oldval[i];
+            }
+        }
+        free(oldkey);
+        free(oldval);
+    }
+    i = mapslot(m, block);
+    if (m->key[i] == ULONG_MAX) {
+        m->key[i] = block;
+        m->used++;
+    }
+    m->val[i] = val;
+    return 0;
+}
+
+/*
+ * freemap - release the arrays of the map and leave it empty
+ */
+static void freemap(struct blockmap *m)
+{
+    free(m->key);
+    free(m->val);
+    memset(m, 0, sizeof(struct blockmap));
+}
+
+/*
+ * emptycache - invalidate every line and clear the policy state and
+ *     the counts
+ */
+static void emptycache(struct cache *c)
+{
+    unsigned long i, lines = (1UL << c->s) * c->stride;
+
+    for (i = 0; i < lines; i++)
+        c->tag[i] = INVALID_TAG;
+    memset(c->stamp, 0, lines * sizeof(unsigned long));
+    memset(c->tree, 0, (1UL << c->s) * sizeof(unsigned long));
+    memset(c->dirty, 0, lines);
+    if (c->arrival != NULL)
+        memset(c->arrival, 0, lines * sizeof(unsigned long));
+    c->clock = 0;
+    c->seed = c->seed0;
+    c->hits = c->misses = c->evictions = c->writebacks = 0;
+    c->prefetches = c->useful = c->late = c->useless = c->pending = 0;
+}
+
+/*
+ * initcache - allocate the tag, policy and dirty arrays, every line invalid
+ */
+static int initcache(struct cache *c, unsigned int s, unsigned int E,
+                     unsigned int b, enum cache_policy policy)
+{
+    unsigned long lines;
+
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    c->policy = policy;
+    c->stride = (E + WAY_GROUP - 1) / WAY_GROUP * WAY_GROUP;
+    c->future = NULL;
+    c->arrival = NULL;
+    c->seed0 = SEED;
+
+    lines = (1UL << s) * c->stride;
+    c->tag = malloc(lines * sizeof(unsigned long));
+    c->stamp = malloc(lines * sizeof(unsigned long));
+    c->tree = malloc((1UL << s) * sizeof(unsigned long));
+    c->dirty = malloc(lines);
+    if (c->tag == NULL || c->stamp == NULL || c->tree == NULL ||
+        c->dirty == NULL)
+        return -1;
+    emptycache(c);
+    return 0;
+}
+
+/*
+ * freecache - release the arrays of the cache
+ */
+static void freecache(struct cache *c)
+{
+    free(c->tag);
+    free(c->stamp);
+    free(c->tree);
+    free(c->dirty);
+    free(c->arrival);
+}
+
+/*
+ * lookup - return the line index of the block of address, or -1
+ */
+static long lookup(struct cache *c, unsigned long address)
+{
+    unsigned long set = (address >> c->b) & ((1UL << c->s) - 1);
+    unsigned long tag = (address >> c->b) >> c->s;
+    int way = findway(c->tag + set * c->stride, c->stride, tag);
+
+    return way < 0 ? -1 : (long)(set * c->stride + way);
+}
+
+/*
+ * dropprefetch - a line is leaving the cache, count its prefetch as
+ *     useless if it was never used
+ */
+static void dropprefetch(struct cache *c, long line)
+{
+    if (c->arrival != NULL && c->arrival[line] != 0) {
+        c->arrival[line] = 0;
+        c->useless++;
+        c->pending--;
+    }
+}
+
+/*
+ * useprefetch - a demand access hit the line; return 1 if it was the
+ *     first use of a prefetched block, counted as late if the block had
+ *     not arrived yet
+ */
+static int useprefetch(struct cache *c, long line)
+{
+    unsigned long now = c->hits + c->misses;
+
+    if (c->arrival == NULL || c->arrival[line] == 0)
+        return 0;
+    if (now - (c->arrival[line] - 1) < c->latency)
+        c->late++;
+    else
+        c->useful++;
+    c->arrival[line] = 0;
+    c->pending--;
+    return 1;
+}
+
+/*
+ * xorshift - next pseudo random number of the cache, the same run after run
+ */
+static unsigned long xorshift(struct cache *c)
+{
+    unsigned long x = c->seed;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return c->seed = x;
+}
+
+/*
+ * touch - update the policy state of a line that was just used
+ */
+static void touch(struct cache *c, long line)
+{
+    unsigned long set = line / c->stride;
+    unsigned int node;
+
+    switch (c->policy) {
+    case CACHE_LRU:
+        c->stamp[line] = ++c->clock;
+        break;
+    case CACHE_PLRU:
+        /* leaves of the tree are nodes E..2E-1, turn every node on the
+           path to point at the other half */
+        for (node = c->E + line % c->stride; node > 1; node >>= 1) {
+            if (node & 1)
+                c->tree[set] &= ~(1UL << (node >> 1));
+            else
+                c->tree[set] |= 1UL << (node >> 1);
+        }
+        break;
+    case CACHE_SRRIP:
+    case CACHE_BRRIP:
+        c->stamp[line] = 0;
+        break;
+    default:
+        /* FIFO and RANDOM ignore hits, OPT only looks at the future */
+        break;
+    }
+}
+
+/*
+ * insert - set the policy state of a line that was just filled
+ */
+static void insert(struct cache *c, long line)
+{
+    switch (c->policy) {
+    case CACHE_FIFO:
+        c->stamp[line] = ++c->clock;
+        break;
+    case CACHE_SRRIP:
+        c->stamp[line] = RRPV_MAX - 1;
+        break;
+    case CACHE_BRRIP:
+        /* bimodal: mostly distant, once in 32 fills long */
+        c->stamp[line] = (xorshift(c) & 31) ? RRPV_MAX : RRPV_MAX - 1;
+        break;
+    default:
+        touch(c, line);
+        break;
+    }
+}
+
+/*
+ * victim - choose the way to evict from a full set
+ */
+static unsigned int victim(struct cache *c, unsigned long set)
+{
+    unsigned long *row = c->tag + set * c->stride;
+    unsigned long *stamp = c->stamp + set * c->stride;
+    unsigned long next, latest = 0;
+    unsigned int i, way = 0, node;
+
+    switch (c->policy) {
+    case CACHE_PLRU:
+        for (node = 1; node < c->E; )
+            node = 2 * node + (c->tree[set] >> node & 1);
+        return node - c->E;
+    case CACHE_SRRIP:
+    case CACHE_BRRIP:
+        /* age the whole set until some line is predicted distant */
+        for (;;) {
+            for (i = 0; i < c->E; i++) {
+                if (stamp[i] >= RRPV_MAX)
+                    return i;
+            }
+            for (i = 0; i < c->E; i++)
+                stamp[i]++;
+        }
+    case CACHE_RANDOM:
+        return xorshift(c) % c->E;
+    case CACHE_OPT:
+        /* the block used furthest in the future, or never again */
+        for (i = 0; i < c->E; i++) {
+            next = mapget(&c->future->map, row[i] << c->s | set, NEVER);
+            if (next == NEVER)
+                return i;
+            if (next > latest) {
+                latest = next;
+                way = i;
+            }
+        }
+        return way;
+    default:
+        /* LRU and FIFO: the oldest stamp */
+        for (i = 1; i < c->E; i++) {
+            if (stamp[i] < stamp[way])
+                way = i;
+        }
+        return way;
+    }
+}
+
+/*
+ * fill - load the block of address into its set, taking an empty line
+ *     if there is one, else evicting the victim of the policy. Returns 1
+ *     and the victim's block address and dirty bit if a line was evicted.
+ */
+static int fill(struct cache *c, unsigned long address, int dirty,
+                unsigned long *evicted, int *evicteddirty)
+{
+    unsigned long set = (address >> c->b) & ((1UL << c->s) - 1);
+    unsigned long tag = (address >> c->b) >> c->s;
+    unsigned long *row = c->tag + set * c->stride;
+    unsigned int way;
+    int full = 0;
+    long line;
+
+    for (way = 0; way < c->E && row[way] != INVALID_TAG; way++)
+        ;
+    if (way == c->E) {
+        full = 1;
+        way = victim(c, set);
+        *evicted = ((row[way] << c->s | set) << c->b);
+        *evicteddirty = c->dirty[set * c->stride + way];
+        dropprefetch(c, set * c->stride + way);
+    }
+    line = set * c->stride + way;
+    row[way] = tag;
+    c->dirty[line] = dirty;
+    insert(c, line);
+    return full;
+}
+
+/*
+ * invalidate - drop every line of the cache inside the block of size
+ *     1<<b at address. Returns 1 if any of them was dirty.
+ */
+static int invalidate(struct cache *c, unsigned long address, unsigned int b)
+{
+    unsigned long a, end;
+    int dirty = 0;
+    long line;
+
+    address &= ~((1UL << b) - 1);
+    end = address + (1UL << b);
+    for (a = address; a < end; a += 1UL << c->b) {
+        if ((line = lookup(c, a)) >= 0) {
+            dirty |= c->dirty[line];
+            dropprefetch(c, line);
+            c->tag[line] = INVALID_TAG;
+            c->dirty[line] = 0;
+        }
+    }
+    return dirty;
+}
+
+/*
+ * initshadow - allocate an empty shadow of the given number of lines
+ */
+static struct shadow *initshadow(unsigned long lines)
+{
+    struct shadow *sh = calloc(1, sizeof(struct shadow));
+
+    if (sh == NULL)
+        return NULL;
+    sh->lines = lines;
+    sh->head = sh->tail = NIL;
+    sh->block = malloc(lines * sizeof(unsigned long));
+    sh->prev = malloc(lines * sizeof(unsigned long));
+    sh->next = malloc(lines * sizeof(unsigned long));
+    if (sh->block == NULL || sh->prev == NULL || sh->next == NULL)
+        return NULL;
+    return sh;
+}
+
+/*
+ * freeshadow - release the shadow and its maps
+ */
+static void freeshadow(struct shadow *sh)
+{
+    freemap(&sh->where);
+    freemap(&sh->regions);
+    free(sh->block);
+    free(sh->prev);
+    free(sh->next);
+    free(sh->region);
+    free(sh);
+}
+
+/*
+ * dropline - take a line out of the LRU list of the shadow
+ */
+static void dropline(struct shadow *sh, unsigned long line)
+{
+    if (sh->prev[line] != NIL)
+        sh->next[sh->prev[line]] = sh->next[line];
+    else
+        sh->head = sh->next[line];
+    if (sh->next[line] != NIL)
+        sh->prev[sh->next[line]] = sh->prev[line];
+    else
+        sh->tail = sh->prev[line];
+}
+
+/*
+ * pushfront - make a line the most recently used of the shadow
+ */
+static void pushfront(struct shadow *sh, unsigned long line)
+{
+    sh->prev[line] = NIL;
+    sh->next[line] = sh->head;
+    if (sh->head != NIL)
+        sh->prev[sh->head] = line;
+    else
+        sh->tail = line;
+    sh->head = line;
+}
+
+/*
+ * classify - run a demand access of a level through its shadow, and
+ *     count the class of the miss if the level missed. Returns 0, or -1
+ *     if the shadow can not grow, after which it must not be used again.
+ */
+static int classify(struct shadow *sh, int regionbits, unsigned long address,
+                     unsigned int b, int hit)
+{
+    unsigned long block = address >> b;
+    unsigned long line = mapget(&sh->where, block, NIL);
+    enum cache_class cl;
+    int err = 0;
+
+    if (line < sh->lines) {
+        cl = CACHE_CONFLICT;
+        dropline(sh, line);
+    } else {
+        cl = line == NIL ? CACHE_COMPULSORY : CACHE_CAPACITY;
+        if (sh->used < sh->lines)
+            line = sh->used++;
+        else {
+            line = sh->tail;
+            dropline(sh, line);
+            err |= mapput(&sh->where, sh->block[line], SEEN) < 0;
+        }
+        sh->block[line] = block;
+        err |= mapput(&sh->where, block, line) < 0;
+    }
+    pushfront(sh, line);
+    if (err)
+        return -1;
+    if (hit)
+        return 0;
+
+    sh->count[cl]++;
+    if (regionbits >= 0) {
+        unsigned long r = address >> regionbits;
+        unsigned long k = mapget(&sh->regions, r, NIL);
+        if (k == NIL) {
+            k = sh->nregion++;
+            if (k == sh->maxregion) {
+                cache_region_t *bigger;
+                sh->maxregion = sh->maxregion ? 2 * sh->maxregion : 64;
+                bigger = realloc(sh->region,
+                                 sh->maxregion * sizeof(cache_region_t));
+                if (bigger == NULL)
+                    return -1;
+                sh->region = bigger;
+            }
+            memset(&sh->region[k], 0, sizeof(cache_region_t));
+            sh->region[k].region = r << regionbits;
+            if (mapput(&sh->regions, r, k) < 0)
+                return -1;
+        }
+        sh->region[k].count[cl]++;
+    }
+    return 0;
+}
+
+static void place(cache_t *c, int i, unsigned long address, int dirty);
+static void reference(cache_t *c, int i, unsigned long address, int write);
+
+/*
+ * evict - handle a block evicted from level i: an inclusive level takes
+ *     it out of the levels above, a dirty block is written back, and an
+ *     exclusive level below takes the victim in
+ */
+static void evict(cache_t *c, int i, unsigned long evicted, int dirty)
+{
+    struct level *lv = c->lv;
+    int j;
+
+    lv[i].c.evictions++;
+    if (lv[i].incl == CACHE_INCLUSIVE) {
+        for (j = 0; j < i; j++)
+            dirty |= invalidate(&lv[j].c, evicted, lv[i].c.b);
+    }
+    if (dirty)
+        lv[i].c.writebacks++;
+    if (i + 1 < c->nlevels && (dirty || lv[i+1].incl == CACHE_EXCLUSIVE))
+        place(c, i + 1, evicted, dirty);
+}
+
+/*
+ * place - put a block coming from the level above into level i, either
+ *     a written back dirty block or a victim for an exclusive level
+ */
+static void place(cache_t *c, int i, unsigned long address, int dirty)
+{
+    struct level *lv = &c->lv[i];
+    unsigned long evicted;
+    int evicteddirty;
+    long line;
+
+    /* a write-through level passes written back data on, allocating nothing */
+    if (dirty && lv->writethrough) {
+        if (i + 1 < c->nlevels)
+            place(c, i + 1, address, dirty);
+        return;
+    }
+    if ((line = lookup(&lv->c, address)) >= 0) {
+        lv->c.dirty[line] |= dirty;
+        return;
+    }
+    if (fill(&lv->c, address, dirty, &evicted, &evicteddirty))
+        evict(c, i, evicted, evicteddirty);
+}
+
+/*
+ * fetch - fill the block of address into level i from below; an
+ *     exclusive level below hands its copy up
+ */
+static void fetch(cache_t *c, int i, unsigned long address, int write)
+{
+    struct level *lv = &c->lv[i];
+    unsigned long evicted;
+    int evicteddirty, dirty = 0;
+    long line;
+
+    if (i + 1 < c->nlevels && lv[1].incl == CACHE_EXCLUSIVE) {
+        struct cache *next = &lv[1].c;
+        line = lookup(next, address);
+        if (lv[1].shadow != NULL && !c->failed &&
+            classify(lv[1].shadow, c->regionbits, address, next->b, line >= 0) < 0)
+            c->failed = 1;
+        if (line >= 0) {
+            next->hits++;
+            useprefetch(next, line);
+            dirty = invalidate(next, address, next->b);
+        } else {
+            next->misses++;
+            reference(c, i + 2, address, 0);
+        }
+    } else {
+        reference(c, i + 1, address, 0);
+    }
+
+    if (fill(&lv->c, address, dirty || (write && !lv->writethrough),
+             &evicted, &evicteddirty))
+        evict(c, i, evicted, evicteddirty);
+}
+
+/*
+ * prefetch - bring the block into level i ahead of use, unless it is
+ *     there already
+ */
+static void prefetch(cache_t *c, int i, unsigned long block)
+{
+    struct cache *cc = &c->lv[i].c;
+    unsigned long address = block << cc->b;
+    long line;
+
+    /* a stride or stream running off either end of memory */
+    if (block > ULONG_MAX >> cc->b || lookup(cc, address) >= 0)
+        return;
+    fetch(c, i, address, 0);
+
+    /* the levels below may have taken the fill back out already */
+    if ((line = lookup(cc, address)) < 0)
+        return;
+    cc->arrival[line] = cc->hits + cc->misses + 1;
+    cc->prefetches++;
+    cc->pending++;
+}
+
+/*
+ * prefetchstride - train the entry of the current instruction on
+ *     address, and prefetch along its stride once it is confirmed
+ */
+static void prefetchstride(cache_t *c, int i, unsigned long address)
+{
+    struct prefetcher *pf = c->lv[i].pf;
+    struct stride *e = &pf->table[(c->pc ^ c->pc >> 6) & (PF_TABLE - 1)];
+    unsigned int b = c->lv[i].c.b;
+    unsigned long block, prev = address >> b;
+    long stride;
+    unsigned int k;
+
+    if (e->pc != c->pc) {
+        e->pc = c->pc;
+        e->last = address;
+        e->stride = 0;
+        e->confidence = 0;
+        return;
+    }
+    stride = (long)(address - e->last);
+    if (stride == 0)
+        return;
+    e->last = address;
+    if (stride == e->stride) {
+        if (e->confidence < 3)
+            e->confidence++;
+    } else if (e->confidence > 0) {
+        e->confidence--;
+    } else {
+        e->stride = stride;
+    }
+    if (e->confidence < 2)
+        return;
+    /* strides shorter than a block give one prefetch per block */
+    for (k = 0; k < pf->cf.degree; k++) {
+        block = (address + e->stride * (long)(pf->cf.distance + k)) >> b;
+        if (block != prev)
+            prefetch(c, i, block);
+        prev = block;
+    }
+}
+
+/*
+ * prefetchstream - follow the stream the block belongs to, or start
+ *     training a new one in place of the least recently used
+ */
+static void prefetchstream(cache_t *c, int i, unsigned long block)
+{
+    struct prefetcher *pf = c->lv[i].pf;
+    struct stream *st, *lru = &pf->streams[0];
+    long window = PF_WINDOW, ahead, d;
+    unsigned int k;
+
+    if (window < (long)(pf->cf.distance + pf->cf.degree))
+        window = pf->cf.distance + pf->cf.degree;
+    for (st = pf->streams; st < pf->streams + PF_STREAMS; st++) {
+        if (!st->valid) {
+            lru = st;
+            continue;
+        }
+        if (lru->valid && st->used < lru->used)
+            lru = st;
+        d = (long)(block - st->block);
+        if (d == 0 || d > window || d < -window)
+            continue;
+        if (st->dir == 0) {
+            /* the second miss sets the direction */
+            st->dir = d > 0 ? 1 : -1;
+            st->next = block + st->dir * (long)pf->cf.distance;
+        } else if (d * st->dir < 0) {
+            continue;
+        }
+        st->block = block;
+        st->used = ++pf->clock;
+        /* catch up if the accesses overtook the prefetches, then keep
+           up to distance + degree - 1 blocks ahead */
+        ahead = (long)(st->next - block) * st->dir;
+        if (ahead < (long)pf->cf.distance)
+            st->next = block + st->dir * (long)pf->cf.distance;
+        for (k = 0; k < pf->cf.degree; k++) {
+            ahead = (long)(st->next - block) * st->dir;
+            if (ahead >= (long)(pf->cf.distance + pf->cf.degree))
+                break;
+            prefetch(c, i, st->next);
+            st->next += st->dir;
+        }
+        return;
+    }
+    lru->valid = 1;
+    lru->block = block;
+    lru->dir = 0;
+    lru->used = ++pf->clock;
+}
+
+/*
+ * train - show the prefetcher of level i a demand access. A trigger is
+ *     a miss or the first use of a prefetched block, which is what
+ *     next-line and stream act on; stride sees every access.
+ */
+static void train(cache_t *c, int i, unsigned long address, int trigger)
+{
+    struct prefetcher *pf = c->lv[i].pf;
+    unsigned long block = address >> c->lv[i].c.b;
+    unsigned int k;
+
+    switch (pf->cf.kind) {
+    case CACHE_PF_NEXTLINE:
+        for (k = 0; trigger && k < pf->cf.degree; k++)
+            prefetch(c, i, block + pf->cf.distance + k);
+        break;
+    case CACHE_PF_STRIDE:
+        prefetchstride(c, i, address);
+        break;
+    case CACHE_PF_STREAM:
+        if (trigger)
+            prefetchstream(c, i, block);
+        break;
+    }
+}
+
+/*
+ * reference - a load or store of address reaching level i
+ */
+static void reference(cache_t *c, int i, unsigned long address, int write)
+{
+    struct level *lv;
+    int trigger;
+    long line;
+
+    /* past the last level is memory */
+    if (i >= c->nlevels)
+        return;
+    lv = &c->lv[i];
+
+    line = lookup(&lv->c, address);
+    if (lv->shadow != NULL && !c->failed &&
+        classify(lv->shadow, c->regionbits, address, lv->c.b, line >= 0) < 0)
+        c->failed = 1;
+    if (line >= 0) {
+        lv->c.hits++;
+        touch(&lv->c, line);
+        trigger = useprefetch(&lv->c, line);
+        if (write && lv->writethrough)
+            reference(c, i + 1, address, 1);
+        else if (write)
+            lv->c.dirty[line] = 1;
+        if (lv->pf != NULL)
+            train(c, i, address, trigger);
+        return;
+    }
+
+    lv->c.misses++;
+    if (write && lv->writethrough)
+        reference(c, i + 1, address, 1);
+    else
+        fetch(c, i, address, write);
+    if (lv->pf != NULL)
+        train(c, i, address, 1);
+}
+
+/*
+ * demand - one block of an access from the cpu. With a plan, the maps
+ *     of OPT first learn the next use of the block after this one.
+ */
+static void demand(cache_t *c, unsigned long address, int write)
+{
+    int j;
+
+    if (c->now < c->nplan) {
+        for (j = 0; j < c->nfutures; j++) {
+            struct future *f = &c->futures[j];
+            if (mapput(&f->map, address >> f->b, f->next[c->now]) < 0)
+                c->failed = 1;
+        }
+        c->now++;
+    }
+    reference(c, 0, address, write);
+}
+
+/*
+ * planfutures - walk the plan backwards to find the next use of each
+ *     access. Afterwards every map holds the first use of each block,
+ *     which is its next use before the simulation starts.
+ */
+static int planfutures(cache_t *c)
+{
+    struct future *f;
+    unsigned long k, block;
+    int j;
+
+    for (j = 0; j < c->nfutures; j++) {
+        f = &c->futures[j];
+        freemap(&f->map);
+        free(f->next);
+        if ((f->next = malloc((c->nplan + 1) * sizeof(unsigned long))) == NULL)
+            return -1;
+        for (k = c->nplan; k-- > 0; ) {
+            block = c->plan[k] >> f->b;
+            f->next[k] = mapget(&f->map, block, NEVER);
+            if (mapput(&f->map, block, k) < 0)
+                return -1;
+        }
+    }
+    c->now = 0;
+    return 0;
+}
+
+/*
+ * cache_parse_policy - look the name up in policyname
+ */
+int cache_parse_policy(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < NPOLICY; i++) {
+        if (strcmp(name, policyname[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * cache_parse_level - the geometry, then options in any order
+ */
+int cache_parse_level(char *spec, cache_config_t *config)
+{
+    unsigned int s, E, b;
+    int n = 0;
+    char *opt;
+
+    if (sscanf(spec, "%u,%u,%u%n", &s, &E, &b, &n) != 3)
+        return -1;
+    if (E == 0 || s + b >= 64)
+        return -1;
+    config->s = s;
+    config->E = E;
+    config->b = b;
+    config->inclusion = CACHE_NINE;
+    config->writethrough = 0;
+    config->policy = -1;
+    for (opt = strtok(spec + n, ","); opt != NULL; opt = strtok(NULL, ",")) {
+        if (strcmp(opt, "inclusive") == 0)
+            config->inclusion = CACHE_INCLUSIVE;
+        else if (strcmp(opt, "exclusive") == 0)
+            config->inclusion = CACHE_EXCLUSIVE;
+        else if (strcmp(opt, "nine") == 0)
+            config->inclusion = CACHE_NINE;
+        else if (strcmp(opt, "wb") == 0)
+            config->writethrough = 0;
+        else if (strcmp(opt, "wt") == 0)
+            config->writethrough = 1;
+        else if ((config->policy = cache_parse_policy(opt)) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * cache_parse_prefetch - the name, then the numbers
+ */
+int cache_parse_prefetch(char *spec, cache_prefetch_t *pf)
+{
+    unsigned int i, n[3] = { 1, 1, 0 };
+    char *name = strtok(spec, ","), *num;
+
+    if (name == NULL)
+        return -1;
+    for (i = 0; i < NPREFETCHER && strcmp(name, prefetchername[i]); i++)
+        ;
+    if (i == NPREFETCHER)
+        return -1;
+    pf->kind = i;
+    for (i = 0; (num = strtok(NULL, ",")) != NULL; i++) {
+        if (i == 3 || sscanf(num, "%u", &n[i]) != 1)
+            return -1;
+    }
+    if (n[0] == 0)
+        return -1;
+    pf->degree = n[0];
+    pf->distance = n[1];
+    pf->latency = n[2];
+    return 0;
+}
+
+/*
+ * cache_create - check and allocate every level. OPT levels share a
+ *     future map per block size.
+ */
+cache_t *cache_create(const cache_config_t *config, int nlevels, int policy)
+{
+    cache_t *c;
+    struct level *lv;
+    int i, j, p;
+
+    if (nlevels < 1 || nlevels > CACHE_MAXLEVEL ||
+        (c = calloc(1, sizeof(cache_t))) == NULL)
+        return NULL;
+    c->regionbits = -1;
+    for (i = 0; i < nlevels; i++) {
+        const cache_config_t *cf = &config[i];
+        p = cf->policy < 0 ? policy : cf->policy;
+        /* the PLRU tree of a set lives in one word, and victims move
+           between exclusive levels whole */
+        if (cf->E == 0 || cf->s + cf->b >= 64 || p < 0 || p >= (int)NPOLICY ||
+            (p == CACHE_PLRU && (cf->E > 64 || (cf->E & (cf->E - 1)) != 0)) ||
+            (cf->inclusion == CACHE_EXCLUSIVE &&
+             (i == 0 || config[i-1].b != cf->b))) {
+            cache_free(c);
+            return NULL;
+        }
+        lv = &c->lv[i];
+        lv->incl = cf->inclusion;
+        lv->writethrough = cf->writethrough;
+        if (initcache(&lv->c, cf->s, cf->E, cf->b, p) < 0) {
+            c->nlevels = i + 1;
+            cache_free(c);
+            return NULL;
+        }
+        c->nlevels = i + 1;
+        if (p != CACHE_OPT)
+            continue;
+        for (j = 0; j < c->nfutures && c->futures[j].b != cf->b; j++)
+            ;
+        if (j == c->nfutures)
+            c->futures[c->nfutures++].b = cf->b;
+        lv->c.future = &c->futures[j];
+    }
+    return c;
+}
+
+/*
+ * cache_free - release every level, shadow and future
+ */
+void cache_free(cache_t *c)
+{
+    int i;
+
+    if (c == NULL)
+        return;
+    for (i = 0; i < c->nlevels; i++) {
+        freecache(&c->lv[i].c);
+        if (c->lv[i].shadow != NULL)
+            freeshadow(c->lv[i].shadow);
+        free(c->lv[i].pf);
+    }
+    for (i = 0; i < c->nfutures; i++) {
+        freemap(&c->futures[i].map);
+        free(c->futures[i].next);
+    }
+    free(c->plan);
+    free(c);
+}
+
+/*
+ * cache_prefetch - set up the prefetcher and the arrival times of the
+ *     lines of the level, which start out not prefetched
+ */
+int cache_prefetch(cache_t *c, int level, const cache_prefetch_t *pf)
+{
+    struct level *lv;
+    unsigned long lines;
+
+    if (level < 0 || level >= c->nlevels || pf->kind < CACHE_PF_NONE ||
+        pf->kind >= (int)NPREFETCHER || pf->degree == 0)
+        return -1;
+    lv = &c->lv[level];
+    free(lv->pf);
+    lv->pf = NULL;
+    if (pf->kind == CACHE_PF_NONE)
+        return 0;
+    if ((lv->pf = calloc(1, sizeof(struct prefetcher))) == NULL)
+        return -1;
+    lv->pf->cf = *pf;
+    lv->c.latency = pf->latency;
+    lines = (1UL << lv->c.s) * lv->c.stride;
+    if (lv->c.arrival == NULL &&
+        (lv->c.arrival = calloc(lines, sizeof(unsigned long))) == NULL)
+        return -1;
+    return 0;
+}
+
+/*
+ * cache_classify - give every level a shadow of as many lines
+ */
+int cache_classify(cache_t *c, int regionbits)
+{
+    struct level *lv;
+    int i;
+
+    c->regionbits = regionbits < 64 ? regionbits : -1;
+    for (i = 0; i < c->nlevels; i++) {
+        lv = &c->lv[i];
+        if (lv->shadow == NULL &&
+            (lv->shadow = initshadow((1UL << lv->c.s) * lv->c.E)) == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * cache_plan - keep a copy of the plan for cache_reset and find the
+ *     next uses in it
+ */
+int cache_plan(cache_t *c, const unsigned long *addr, unsigned long n)
+{
+    free(c->plan);
+    c->nplan = 0;
+    if ((c->plan = malloc((n + 1) * sizeof(unsigned long))) == NULL)
+        return -1;
+    memcpy(c->plan, addr, n * sizeof(unsigned long));
+    c->nplan = n;
+    return planfutures(c);
+}
+
+/*
+ * cache_access - split the access into the L1 blocks it overlaps
+ */
+int cache_access(cache_t *c, unsigned long addr, unsigned int size, int type)
+{
+    unsigned int b = c->lv[0].c.b;
+    unsigned long block = addr >> b;
+    unsigned long last = size > 1 ? (addr + size - 1) >> b : block;
+
+    /* the common case, one block and no plan */
+    if (block == last && c->nplan == 0) {
+        if (type != CACHE_STORE)
+            reference(c, 0, addr, 0);
+        if (type != CACHE_LOAD)
+            reference(c, 0, addr, 1);
+        return c->failed ? -1 : 0;
+    }
+    for (;;) {
+        if (type != CACHE_STORE)
+            demand(c, addr, 0);
+        if (type != CACHE_LOAD)
+            demand(c, addr, 1);
+        if (block++ == last)
+            break;
+        addr = block << b;
+    }
+    return c->failed ? -1 : 0;
+}
+
+/*
+ * cache_instruction - remember pc for the stride prefetcher
+ */
+void cache_instruction(cache_t *c, unsigned long pc)
+{
+    c->pc = pc;
+}
+
+/*
+ * cache_stats - copy out the counts of a level. Prefetched blocks still
+ *     waiting for their first use count as useless.
+ */
+void cache_stats(const cache_t *c, int level, cache_stats_t *stats)
+{
+    const struct cache *cc = &c->lv[level].c;
+    const struct shadow *sh = c->lv[level].shadow;
+
+    memset(stats, 0, sizeof(cache_stats_t));
+    stats->hits = cc->hits;
+    stats->misses = cc->misses;
+    stats->evictions = cc->evictions;
+    stats->writebacks = cc->writebacks;
+    stats->prefetches = cc->prefetches;
+    stats->useful = cc->useful;
+    stats->late = cc->late;
+    stats->useless = cc->useless + cc->pending;
+    if (sh != NULL)
+        memcpy(stats->classes, sh->count, sizeof(stats->classes));
+}
+
+/*
+ * bymisses - qsort order of regions, most misses first
+ */
+static int bymisses(const void *x, const void *y)
+{
+    const cache_region_t *a = x, *b = y;
+    unsigned long na = a->count[0] + a->count[1] + a->count[2];
+    unsigned long nb = b->count[0] + b->count[1] + b->count[2];
+
+    return (na < nb) - (na > nb);
+}
+
+/*
+ * cache_regions - sort the regions of the level in place. The index
+ *     map is rebuilt, so classifying can go on afterwards; if that runs
+ *     out of memory, classifying stops instead.
+ */
+const cache_region_t *cache_regions(cache_t *c, int level, unsigned long *n)
+{
+    struct shadow *sh = c->lv[level].shadow;
+    unsigned long k;
+
+    *n = 0;
+    if (sh == NULL || c->regionbits < 0 || c->failed)
+        return NULL;
+    qsort(sh->region, sh->nregion, sizeof(cache_region_t), bymisses);
+    for (k = 0; k < sh->nregion; k++) {
+        if (mapput(&sh->regions, sh->region[k].region >> c->regionbits, k) < 0) {
+            c->failed = 1;
+            return NULL;
+        }
+    }
+    *n = sh->nregion;
+    return sh->region;
+}
+
+/*
+ * cache_reset - empty the levels and start over, shadows and
+ *     prefetchers included
+ */
+int cache_reset(cache_t *c)
+{
+    struct shadow *sh;
+    int i;
+
+    for (i = 0; i < c->nlevels; i++) {
+        emptycache(&c->lv[i].c);
+        if (c->lv[i].pf != NULL) {
+            cache_prefetch_t cf = c->lv[i].pf->cf;
+            memset(c->lv[i].pf, 0, sizeof(struct prefetcher));
+            c->lv[i].pf->cf = cf;
+        }
+        if ((sh = c->lv[i].shadow) == NULL)
+            continue;
+        freemap(&sh->where);
+        freemap(&sh->regions);
+        sh->used = sh->nregion = 0;
+        sh->head = sh->tail = NIL;
+        memset(sh->count, 0, sizeof(sh->count));
+    }
+    c->failed = 0;
+    if (c->nplan > 0 && planfutures(c) < 0) {
+        c->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * cache_seed - restart the generator of every level from SEED plus
+ *     seed; xorshift never leaves a zero state, so that one is skipped
+ */
+void cache_seed(cache_t *c, unsigned long seed)
+{
+    int i;
+
+    for (i = 0; i < c->nlevels; i++) {
+        struct cache *lc = &c->lv[i].c;
+        lc->seed0 = SEED + seed != 0 ? SEED + seed : SEED;
+        lc->seed = lc->seed0;
+    }
+}
+
+/*
+ * cache_levels - the number of levels
+ */
+int cache_levels(const cache_t *c)
+{
+    return c->nlevels;
+}
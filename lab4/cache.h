@@ -0,0 +1,173 @@
+/*
+ * cache.h - Cache simulator library, the model behind csim
+ *
+ * A cache_t is a hierarchy of one or more levels, L1 first, each a
+ * set-associative cache with its own geometry, replacement policy,
+ * inclusion and write policy. Accesses go in one at a time through
+ * cache_access and the counts of every level come out of cache_stats,
+ * so any tool can simulate a cache in process, without a trace file.
+ * A level can also have a prefetcher, trained on the accesses that
+ * reach it, which fills blocks from the levels below ahead of use.
+ */
+
+#ifndef CACHELAB_CACHE_H
+#define CACHELAB_CACHE_H
+
+/* Most levels a hierarchy can have */
+#define CACHE_MAXLEVEL 8
+
+/* Replacement policies, OPT needs cache_plan */
+enum cache_policy {
+    CACHE_LRU, CACHE_PLRU, CACHE_SRRIP, CACHE_BRRIP, CACHE_RANDOM,
+    CACHE_FIFO, CACHE_OPT
+};
+
+/* How a level relates to the levels above it (closer to the cpu) */
+enum cache_inclusion { CACHE_NINE, CACHE_INCLUSIVE, CACHE_EXCLUSIVE };
+
+/* Kinds of access, a modify is a load and then a store */
+enum cache_type { CACHE_LOAD, CACHE_STORE, CACHE_MODIFY };
+
+/* Prefetchers, see cache_prefetch */
+enum cache_prefetcher {
+    CACHE_PF_NONE, CACHE_PF_NEXTLINE, CACHE_PF_STRIDE, CACHE_PF_STREAM
+};
+
+/* Miss classes counted after cache_classify */
+enum cache_class { CACHE_COMPULSORY, CACHE_CAPACITY, CACHE_CONFLICT };
+
+/* One level */
+typedef struct cache_config {
+    unsigned int s, E, b;   /* 2^s sets of E lines of 2^b bytes */
+    int policy;             /* enum cache_policy, -1 for the default */
+    int inclusion;          /* enum cache_inclusion */
+    int writethrough;       /* write-through, no-write-allocate if set,
+                               else write-back, write-allocate */
+} cache_config_t;
+
+/* Prefetcher of one level */
+typedef struct cache_prefetch {
+    int kind;               /* enum cache_prefetcher */
+    unsigned int degree;    /* blocks prefetched per trigger */
+    unsigned int distance;  /* how far ahead of the access the first one is,
+                               in blocks, or in strides for CACHE_PF_STRIDE */
+    unsigned int latency;   /* accesses of the level a prefetch takes to
+                               arrive; a use before then is late */
+} cache_prefetch_t;
+
+/* Counts of one level */
+typedef struct cache_stats {
+    unsigned long hits, misses, evictions, writebacks;
+    unsigned long classes[3];   /* misses by enum cache_class */
+    unsigned long prefetches;   /* blocks filled by the prefetcher */
+    unsigned long useful;       /* used after they arrived */
+    unsigned long late;         /* used while still on their way */
+    unsigned long useless;      /* evicted or still there, never used */
+} cache_stats_t;
+
+/* Misses of one address region by enum cache_class */
+typedef struct cache_region {
+    unsigned long region;       /* first address of the region */
+    unsigned long count[3];
+} cache_region_t;
+
+typedef struct cachesim cache_t;
+
+/* cache_parse_policy - return the policy called name, or -1 */
+int cache_parse_policy(const char *name);
+
+/*
+ * cache_parse_level - fill config from a level spec
+ *     "s,E,b[,inclusive|exclusive|nine][,wb|wt][,<policy>]", which is
+ *     modified. Returns 0, or -1 if the spec is wrong.
+ */
+int cache_parse_level(char *spec, cache_config_t *config);
+
+/*
+ * cache_parse_prefetch - fill pf from a prefetcher spec
+ *     "nextline|stride|stream[,degree[,distance[,latency]]]", which is
+ *     modified; degree and distance default to 1, latency to 0. Returns
+ *     0, or -1 if the spec is wrong.
+ */
+int cache_parse_prefetch(char *spec, cache_prefetch_t *pf);
+
+/*
+ * cache_create - build an empty hierarchy of nlevels levels. Levels
+ *     with no policy of their own get policy. Returns NULL if the
+ *     configuration is wrong or memory runs out.
+ */
+cache_t *cache_create(const cache_config_t *config, int nlevels, int policy);
+
+/* cache_free - release the hierarchy */
+void cache_free(cache_t *c);
+
+/*
+ * cache_prefetch - give level a prefetcher, or take it away with
+ *     CACHE_PF_NONE. Next-line prefetches the blocks after every miss,
+ *     and after the first use of a prefetched block. Stride keeps the
+ *     last address and stride of each instruction (see cache_instruction)
+ *     and prefetches along a stride seen twice in a row. Stream follows
+ *     up to 16 runs of misses through nearby blocks, up or down, and
+ *     keeps distance blocks ahead of each. Returns 0, or -1 if the level
+ *     or prefetcher is wrong or memory runs out.
+ */
+int cache_prefetch(cache_t *c, int level, const cache_prefetch_t *pf);
+
+/*
+ * cache_classify - classify the misses of every level from now on,
+ *     and break them down by regions of 2^regionbits bytes unless
+ *     regionbits is negative. Returns 0, or -1 if out of memory.
+ */
+int cache_classify(cache_t *c, int regionbits);
+
+/*
+ * cache_plan - give OPT levels the n blocks to be accessed, one address
+ *     per block touched by cache_access, in order. Returns 0, or -1 if
+ *     out of memory.
+ */
+int cache_plan(cache_t *c, const unsigned long *addr, unsigned long n);
+
+/*
+ * cache_access - simulate a load, store or modify of size bytes at
+ *     addr, touching every L1 block the bytes overlap. A size of 0 or 1
+ *     touches one block, as csim does for every access of a trace.
+ *     Returns 0, or -1 once classifying or the OPT plan has run out of
+ *     memory; the hits and misses are still counted, but the miss
+ *     classes stop and OPT is no longer optimal.
+ */
+int cache_access(cache_t *c, unsigned long addr, unsigned int size, int type);
+
+/*
+ * cache_instruction - the accesses from now on are made by the
+ *     instruction at pc, like the "I" line before them in a lackey trace
+ */
+void cache_instruction(cache_t *c, unsigned long pc);
+
+/* cache_stats - the counts of level (0 for L1) so far */
+void cache_stats(const cache_t *c, int level, cache_stats_t *stats);
+
+/*
+ * cache_regions - the regions of level by misses, most first, and
+ *     their number in *n; NULL unless classifying by region, or if out
+ *     of memory
+ */
+const cache_region_t *cache_regions(cache_t *c, int level, unsigned long *n);
+
+/*
+ * cache_reset - empty every level and clear the counts; classifying,
+ *     the prefetchers and the plan, restarted from its beginning, are
+ *     kept. Returns 0, or -1 if the plan is out of memory.
+ */
+int cache_reset(cache_t *c);
+
+/*
+ * cache_seed - draw the random numbers of RANDOM and BRRIP from another
+ *     sequence, one per seed, now and after cache_reset; 0 is the
+ *     sequence of a new hierarchy
+ */
+void cache_seed(cache_t *c, unsigned long seed);
+
+/* cache_levels - the number of levels */
+int cache_levels(const cache_t *c);
+
+#endif /* CACHELAB_CACHE_H */
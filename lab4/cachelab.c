@@ -9,6 +9,8 @@
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0; 
+inplace_func_t inplace_list[MAX_TRANS_FUNCS];
+int inplace_counter = 0;
 
 /* 
  * printSummary - Summarize the cache simulation statistics. Student
@@ -82,3 +84,15 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/*
+ * registerInplaceFunction - Add the given in-place trans function into
+ *     the list that test-trans -i and tracegen -T evaluate
+ */
+void registerInplaceFunction(void (*trans)(int M, int N, int *A),
+                             char* desc)
+{
+    inplace_list[inplace_counter].func_ptr = trans;
+    inplace_list[inplace_counter].description = desc;
+    inplace_counter++;
+}
@@ -16,6 +16,12 @@ typedef struct trans_func{
     unsigned int num_evictions;
 } trans_func_t;
 
+/* An in-place transpose: A is N x M on entry and M x N on return */
+typedef struct inplace_func{
+    void (*func_ptr)(int M, int N, int *A);
+    char* description;
+} inplace_func_t;
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
@@ -34,4 +40,8 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(void (*trans)(int M,int N,int[N][M],int[M][N]), 
                            char* desc);
 
+/* Add the given in-place trans function into the in-place list */
+void registerInplaceFunction(void (*trans)(int M, int N, int *A),
+                             char* desc);
+
 #endif /* CACHELAB_TOOLS_H */
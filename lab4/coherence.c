@@ -0,0 +1,445 @@
+/*
+ * coherence.c - Multi-core cache coherence model, see coherence.h
+ *
+ * The caches are flat arrays like the levels of cache.c, one row of E
+ * lines per set, with LRU replacement. Next to them every block touched
+ * so far has a record of which cores hold it, so a bus transaction only
+ * snoops the caches that have a copy, of which cores lost it to an
+ * invalidation, and for each of those of the bytes other cores wrote
+ * since, one bit per 1/64 of the block, to tell true sharing from false
+ * sharing when the core misses on it again.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "coherence.h"
+
+/* States of a line; an invalid line holds no block */
+enum state { INVALID, SHARED, EXCLUSIVE, OWNED, MODIFIED };
+
+/* Bytes of a block are tracked in this many pieces */
+#define PIECES 64
+
+/* Map key of an empty slot, no block number reaches it */
+#define EMPTY ULONG_MAX
+
+static const char *protocolname[] = { "mesi", "moesi" };
+#define NPROTOCOL (sizeof(protocolname) / sizeof(protocolname[0]))
+
+/* The private cache of one core */
+struct core {
+    unsigned long *tag;     /* block number */
+    unsigned char *state;   /* enum state */
+    unsigned long *stamp;   /* time of the last use */
+    coh_core_stats_t st;
+};
+
+/* What the model knows about one block */
+struct line {
+    coh_line_t pub;
+    unsigned long holders;  /* bit k set if core k has a copy */
+    unsigned long lost;     /* bit k set if core k lost it to a write */
+};
+
+struct coherence {
+    int ncores, protocol;
+    unsigned int s, E, b;
+    unsigned int piece;     /* bytes per bit of a written mask */
+    unsigned long clock;
+    struct core core[COH_MAXCORES];
+    coh_bus_stats_t bus;
+
+    /* the blocks, and an open addressing map from number to index */
+    struct line *line;
+    unsigned long *written; /* ncores masks per line */
+    unsigned long nline, maxline;
+    unsigned long *key, *val;
+    unsigned long mask;     /* capacity of key/val minus one */
+};
+
+/*
+ * outofmemory - give up when the block records can not grow
+ */
+static void outofmemory(void)
+{
+    fprintf(stderr, "Error: out of memory for coherence records\n");
+    exit(1);
+}
+
+/*
+ * mapslot - return the slot of block in the map, or the empty slot
+ *     where it would go
+ */
+static unsigned long mapslot(const coh_t *c, unsigned long block)
+{
+    unsigned long h = block * 0x9e3779b97f4a7c15UL;
+    unsigned long i = (h ^ h >> 29) & c->mask;
+
+    while (c->key[i] != block && c->key[i] != EMPTY)
+        i = (i + 1) & c->mask;
+    return i;
+}
+
+/*
+ * growmap - double the map, rehashing every block
+ */
+static void growmap(coh_t *c)
+{
+    unsigned long i, j, oldsize = c->key == NULL ? 0 : c->mask + 1;
+    unsigned long size = oldsize ? 2 * oldsize : 1024;
+    unsigned long *oldkey = c->key, *oldval = c->val;
+
+    c->key = malloc(size * sizeof(unsigned long));
+    c->val = malloc(size * sizeof(unsigned long));
+    if (c->key == NULL || c->val == NULL)
+        outofmemory();
+    c->mask = size - 1;
+    for (i = 0; i < size; i++)
+        c->key[i] = EMPTY;
+    for (i = 0; i < oldsize; i++) {
+        if (oldkey[i] != EMPTY) {
+            j = mapslot(c, oldkey[i]);
+            c->key[j] = oldkey[i];
+            c->val[j] = oldval[i];
+        }
+    }
+    free(oldkey);
+    free(oldval);
+}
+
+/*
+ * record - return the record of block, adding an empty one the first
+ *     time the block is seen
+ */
+static struct line *record(coh_t *c, unsigned long block)
+{
+    unsigned long i;
+
+    if (c->key == NULL || 2 * (c->nline + 1) > c->mask + 1)
+        growmap(c);
+    i = mapslot(c, block);
+    if (c->key[i] != EMPTY)
+        return &c->line[c->val[i]];
+
+    if (c->nline == c->maxline) {
+        struct line *line;
+        unsigned long *written;
+        c->maxline = c->maxline ? 2 * c->maxline : 1024;
+        line = realloc(c->line, c->maxline * sizeof(struct line));
+        if (line == NULL)
+            outofmemory();
+        c->line = line;
+        written = realloc(c->written,
+                          c->maxline * c->ncores * sizeof(unsigned long));
+        if (written == NULL)
+            outofmemory();
+        c->written = written;
+    }
+    c->key[i] = block;
+    c->val[i] = c->nline;
+    memset(&c->line[c->nline], 0, sizeof(struct line));
+    memset(&c->written[c->nline * c->ncores], 0,
+           c->ncores * sizeof(unsigned long));
+    c->line[c->nline].pub.addr = block << c->b;
+    return &c->line[c->nline++];
+}
+
+/*
+ * writtenby - the mask of the bytes of l written by other cores since
+ *     core lost it
+ */
+static unsigned long *writtenby(coh_t *c, struct line *l, int core)
+{
+    return &c->written[(l - c->line) * c->ncores + core];
+}
+
+/*
+ * bytemask - the pieces of the block covered by size bytes at addr
+ */
+static unsigned long bytemask(const coh_t *c, unsigned long addr,
+                              unsigned int size)
+{
+    unsigned long bsize = 1UL << c->b;
+    unsigned long off = addr & (bsize - 1);
+    unsigned long end = size == 0 || off + size > bsize ? bsize : off + size;
+    unsigned int first = off / c->piece, last = (end - 1) / c->piece;
+
+    if (last - first + 1 >= PIECES)
+        return ~0UL;
+    return ((1UL << (last - first + 1)) - 1) << first;
+}
+
+/*
+ * findline - return the index of block in the cache of core, or -1
+ */
+static long findline(const coh_t *c, int core, unsigned long block)
+{
+    const struct core *k = &c->core[core];
+    unsigned long row = (block & ((1UL << c->s) - 1)) * c->E;
+    unsigned int i;
+
+    for (i = 0; i < c->E; i++) {
+        if (k->state[row + i] != INVALID && k->tag[row + i] == block)
+            return row + i;
+    }
+    return -1;
+}
+
+/*
+ * invalidate - drop the copy of core, which loses the block to a write
+ */
+static void invalidate(coh_t *c, struct line *l, int core, long i)
+{
+    c->core[core].state[i] = INVALID;
+    c->core[core].st.invalidated++;
+    l->holders &= ~(1UL << core);
+    l->lost |= 1UL << core;
+    *writtenby(c, l, core) = 0;
+    l->pub.invalidations++;
+    c->bus.invalidations++;
+}
+
+/*
+ * snoop - the other holders of the block see a BusRd, or a BusRdX or
+ *     upgrade if write is set; need is set unless the requester already
+ *     has the data. Returns 1 if any of them keeps a copy.
+ */
+static int snoop(coh_t *c, struct line *l, int core, unsigned long block,
+                 int write, int need)
+{
+    unsigned long others = l->holders & ~(1UL << core);
+    int o, shared = 0;
+
+    for (o = 0; others != 0; o++, others >>= 1) {
+        long i;
+        unsigned char *state;
+        if (!(others & 1))
+            continue;
+        i = findline(c, o, block);
+        state = &c->core[o].state[i];
+
+        /* a dirty copy supplies the data instead of memory */
+        if (*state == MODIFIED || *state == OWNED) {
+            if (need)
+                c->bus.transfers++;
+            if (!write && *state == MODIFIED) {
+                if (c->protocol == COH_MESI) {
+                    c->bus.writebacks++;
+                    *state = SHARED;
+                }
+                else
+                    *state = OWNED;
+            }
+        }
+        else if (*state == EXCLUSIVE && !write)
+            *state = SHARED;
+
+        if (write)
+            invalidate(c, l, o, i);
+        else
+            shared = 1;
+    }
+    return shared;
+}
+
+/*
+ * fill - place block in the cache of core in place of the LRU line
+ */
+static void fill(coh_t *c, struct line *l, int core, unsigned long block,
+                 enum state state)
+{
+    struct core *k = &c->core[core];
+    unsigned long row = (block & ((1UL << c->s) - 1)) * c->E;
+    unsigned long v = row;
+    unsigned int i;
+
+    for (i = 0; i < c->E; i++) {
+        if (k->state[row + i] == INVALID) {
+            v = row + i;
+            break;
+        }
+        if (k->stamp[row + i] < k->stamp[v])
+            v = row + i;
+    }
+    if (k->state[v] != INVALID) {
+        k->st.evictions++;
+        if (k->state[v] == MODIFIED || k->state[v] == OWNED)
+            c->bus.writebacks++;
+        c->line[c->val[mapslot(c, k->tag[v])]].holders &= ~(1UL << core);
+    }
+    k->tag[v] = block;
+    k->state[v] = state;
+    k->stamp[v] = c->clock;
+    l->holders |= 1UL << core;
+}
+
+/*
+ * coh_parse_protocol - look the name up in protocolname
+ */
+int coh_parse_protocol(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < NPROTOCOL; i++) {
+        if (strcmp(name, protocolname[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * coh_create - allocate every core's cache, the block records grow
+ *     on demand
+ */
+coh_t *coh_create(int cores, unsigned int s, unsigned int E, unsigned int b,
+                  int protocol)
+{
+    unsigned long lines = (1UL << s) * E;
+    coh_t *c;
+    int k;
+
+    if (cores < 1 || cores > COH_MAXCORES || E == 0 || s > 30 || b > 30 ||
+        (protocol != COH_MESI && protocol != COH_MOESI) ||
+        (c = calloc(1, sizeof(coh_t))) == NULL)
+        return NULL;
+    c->ncores = cores;
+    c->protocol = protocol;
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    c->piece = (1U << b) > PIECES ? (1U << b) / PIECES : 1;
+    for (k = 0; k < cores; k++) {
+        c->core[k].tag = malloc(lines * sizeof(unsigned long));
+        c->core[k].state = calloc(lines, 1);
+        c->core[k].stamp = calloc(lines, sizeof(unsigned long));
+        if (c->core[k].tag == NULL || c->core[k].state == NULL ||
+            c->core[k].stamp == NULL) {
+            coh_free(c);
+            return NULL;
+        }
+    }
+    return c;
+}
+
+/*
+ * coh_free - release the caches and the block records
+ */
+void coh_free(coh_t *c)
+{
+    int k;
+
+    if (c == NULL)
+        return;
+    for (k = 0; k < c->ncores; k++) {
+        free(c->core[k].tag);
+        free(c->core[k].state);
+        free(c->core[k].stamp);
+    }
+    free(c->line);
+    free(c->written);
+    free(c->key);
+    free(c->val);
+    free(c);
+}
+
+/*
+ * coh_access - a hit, an upgrade or a miss, then note the bytes
+ *     written for the cores that lost the block
+ */
+void coh_access(coh_t *c, int core, unsigned long addr, unsigned int size,
+                int write)
+{
+    unsigned long block = addr >> c->b;
+    unsigned long bytes = bytemask(c, addr, size);
+    struct core *k = &c->core[core];
+    struct line *l = record(c, block);
+    long i = findline(c, core, block);
+    unsigned long lost;
+    int o;
+
+    c->clock++;
+    l->pub.cores |= 1UL << core;
+    if (i >= 0) {
+        k->st.hits++;
+        k->stamp[i] = c->clock;
+        if (write && (k->state[i] == SHARED || k->state[i] == OWNED)) {
+            c->bus.upgrades++;
+            snoop(c, l, core, block, 1, 0);
+        }
+        if (write)
+            k->state[i] = MODIFIED;
+    }
+    else {
+        k->st.misses++;
+        if (l->lost & (1UL << core)) {
+            k->st.coherence++;
+            if (*writtenby(c, l, core) & bytes) {
+                l->pub.truesharing++;
+                c->bus.truesharing++;
+            }
+            else {
+                l->pub.falsesharing++;
+                c->bus.falsesharing++;
+            }
+            l->lost &= ~(1UL << core);
+            *writtenby(c, l, core) = 0;
+        }
+        if (write) {
+            c->bus.readx++;
+            snoop(c, l, core, block, 1, 1);
+            fill(c, l, core, block, MODIFIED);
+        }
+        else {
+            c->bus.reads++;
+            fill(c, l, core, block, snoop(c, l, core, block, 0, 1) ? SHARED : EXCLUSIVE);
+        }
+    }
+
+    if (write) {
+        for (o = 0, lost = l->lost; lost != 0; o++, lost >>= 1) {
+            if (lost & 1)
+                *writtenby(c, l, o) |= bytes;
+        }
+    }
+}
+
+/*
+ * coh_core_stats - copy out the counts of core
+ */
+void coh_core_stats(const coh_t *c, int core, coh_core_stats_t *stats)
+{
+    *stats = c->core[core].st;
+}
+
+/*
+ * coh_bus_stats - copy out the counts of the bus
+ */
+void coh_bus_stats(const coh_t *c, coh_bus_stats_t *stats)
+{
+    *stats = c->bus;
+}
+
+/*
+ * coh_falsesharing - insertion into top, which stays sorted
+ */
+int coh_falsesharing(const coh_t *c, coh_line_t *top, int n)
+{
+    unsigned long j;
+    int m = 0, k;
+
+    if (n <= 0)
+        return 0;
+    for (j = 0; j < c->nline; j++) {
+        const coh_line_t *l = &c->line[j].pub;
+        if (l->falsesharing == 0 ||
+            (m == n && l->falsesharing <= top[m - 1].falsesharing))
+            continue;
+        if (m < n)
+            m++;
+        for (k = m - 1; k > 0 && top[k - 1].falsesharing < l->falsesharing; k--)
+            top[k] = top[k - 1];
+        top[k] = *l;
+    }
+    return m;
+}
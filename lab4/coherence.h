@@ -0,0 +1,86 @@
+/*
+ * coherence.h - Multi-core cache coherence model, run by csim -C
+ *
+ * Every core has a private write-back cache, all of the same geometry,
+ * kept coherent over a snooping bus with the MESI or MOESI protocol. A
+ * read miss asks the other cores for the block: a Modified copy supplies
+ * it and, under MESI, writes it back and drops to Shared, under MOESI
+ * keeps it as Owned. A write invalidates every other copy, with a bus
+ * upgrade if the writer already has the block Shared or Owned.
+ *
+ * A miss on a block the core lost to an invalidation is a coherence
+ * miss. It is true sharing if the bytes it accesses were written by
+ * another core since the invalidation, and false sharing if only other
+ * bytes of the block were: the two cores merely share a line.
+ */
+
+#ifndef CACHELAB_COHERENCE_H
+#define CACHELAB_COHERENCE_H
+
+/* Most cores a model can have */
+#define COH_MAXCORES 64
+
+/* Protocols */
+enum coh_protocol { COH_MESI, COH_MOESI };
+
+/* Counts of one core */
+typedef struct coh_core_stats {
+    unsigned long hits, misses, evictions;
+    unsigned long coherence;    /* misses on blocks lost to invalidations */
+    unsigned long invalidated;  /* copies other cores invalidated */
+} coh_core_stats_t;
+
+/* Counts of the bus */
+typedef struct coh_bus_stats {
+    unsigned long reads;        /* BusRd, read misses */
+    unsigned long readx;        /* BusRdX, write misses */
+    unsigned long upgrades;     /* writes to a Shared or Owned copy */
+    unsigned long invalidations;
+    unsigned long transfers;    /* blocks supplied by another core */
+    unsigned long writebacks;   /* dirty blocks written to memory */
+    unsigned long truesharing, falsesharing;    /* coherence misses */
+} coh_bus_stats_t;
+
+/* Coherence traffic of one block */
+typedef struct coh_line {
+    unsigned long addr;         /* first address of the block */
+    unsigned long invalidations;
+    unsigned long truesharing, falsesharing;
+    unsigned long cores;        /* bit k set if core k accessed it */
+} coh_line_t;
+
+typedef struct coherence coh_t;
+
+/* coh_parse_protocol - return the protocol called name, or -1 */
+int coh_parse_protocol(const char *name);
+
+/*
+ * coh_create - cores empty caches of 2^s sets of E lines of 2^b bytes.
+ *     Returns NULL if the configuration is wrong or out of memory.
+ */
+coh_t *coh_create(int cores, unsigned int s, unsigned int E, unsigned int b,
+                  int protocol);
+
+/* coh_free - release the model */
+void coh_free(coh_t *c);
+
+/*
+ * coh_access - simulate a read or write by core of size bytes at addr.
+ *     Only the block of addr is touched; bytes past its end are ignored.
+ */
+void coh_access(coh_t *c, int core, unsigned long addr, unsigned int size,
+                int write);
+
+/* coh_core_stats - the counts of core so far */
+void coh_core_stats(const coh_t *c, int core, coh_core_stats_t *stats);
+
+/* coh_bus_stats - the counts of the bus so far */
+void coh_bus_stats(const coh_t *c, coh_bus_stats_t *stats);
+
+/*
+ * coh_falsesharing - copy the at most n blocks with the most false
+ *     sharing misses into top, most first, and return how many there are
+ */
+int coh_falsesharing(const coh_t *c, coh_line_t *top, int n);
+
+#endif /* CACHELAB_COHERENCE_H */
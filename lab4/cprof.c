@@ -0,0 +1,386 @@
+/*
+ * cprof.c - Cache behavior profiler for memory traces
+ *
+ * Reads a text or binary trace, like csim, and reports
+ *   - the reuse distance histogram: for every access, how many distinct
+ *     blocks were touched since the last access to the same block. A
+ *     fully associative LRU cache of C blocks hits exactly the accesses
+ *     at distance below C.
+ *   - the working set over time: distinct blocks touched per window of
+ *     accesses.
+ *   - miss attribution: accesses and misses (distance of at least C, or
+ *     first touch) per aligned address region, busiest regions first.
+ *
+ * Reuse distances take O(log n) each: a Fenwick tree over access time
+ * holds a 1 at the last access of every block, so the distance is the
+ * count of ones after the block's previous access. When the time runs
+ * past the tree, the live blocks are renumbered in order and the tree is
+ * rebuilt, so memory follows the number of blocks, not the trace length.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace.h"
+
+/* Key of an empty map slot */
+#define EMPTY ULONG_MAX
+
+/* Smallest Fenwick tree, in accesses */
+#define MINTREE (1UL << 20)
+
+/* Reuse distance buckets: 0, 1, 2-3, 4-7, ... and first touches */
+#define NBUCKET 64
+
+/* Map slot; for blocks a is the time of the last access and b its
+ * window, for regions a counts accesses and b misses */
+struct slot {
+    unsigned long key;
+    unsigned long a, b;
+};
+
+struct map {
+    unsigned long mask;    /* capacity minus one */
+    unsigned long used;
+    struct slot *slot;
+};
+
+static struct map blocks, regions;
+
+/* Fenwick tree over time, 1-based, tree[0] unused */
+static unsigned int *tree;
+static unsigned long treesize, now;
+
+static unsigned long hist[NBUCKET], cold, accesses;
+
+/* Blocks touched in the current window */
+static unsigned long distinct;
+
+/* Options */
+static unsigned int bbits = 6, gbits = 12;
+static unsigned long capacity = 512, window = 10000;
+static int ntop = 20;
+
+/*
+ * mapslot - return the slot of key, or the empty slot where it goes
+ */
+static struct slot *mapslot(struct map *m, unsigned long key)
+{
+    unsigned long h = key * 0x9e3779b97f4a7c15UL;
+    unsigned long i = (h ^ h >> 29) & m->mask;
+
+    while (m->slot[i].key != key && m->slot[i].key != EMPTY)
+        i = (i + 1) & m->mask;
+    return &m->slot[i];
+}
+
+/*
+ * mapget - return the slot of key, adding it zeroed if it is new. The
+ *     map doubles when it gets half full.
+ */
+static struct slot *mapget(struct map *m, unsigned long key)
+{
+    struct slot *old = m->slot, *sl;
+    unsigned long i, oldsize = m->mask + 1;
+
+    if (old == NULL || 2 * (m->used + 1) > oldsize) {
+        unsigned long size = old == NULL ? 4096 : 2 * oldsize;
+        if ((m->slot = malloc(size * sizeof(struct slot))) == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        m->mask = size - 1;
+        for (i = 0; i < size; i++)
+            m->slot[i].key = EMPTY;
+        for (i = 0; old != NULL && i < oldsize; i++) {
+            if (old[i].key != EMPTY)
+                *mapslot(m, old[i].key) = old[i];
+        }
+        free(old);
+    }
+    sl = mapslot(m, key);
+    if (sl->key == EMPTY) {
+        sl->key = key;
+        sl->a = sl->b = 0;
+        m->used++;
+    }
+    return sl;
+}
+
+/*
+ * treeadd - add v at time i
+ */
+static void treeadd(unsigned long i, int v)
+{
+    for (; i <= treesize; i += i & -i)
+        tree[i] += v;
+}
+
+/*
+ * treesum - return the sum of times 1..i
+ */
+static unsigned long treesum(unsigned long i)
+{
+    unsigned long sum = 0;
+
+    for (; i > 0; i -= i & -i)
+        sum += tree[i];
+    return sum;
+}
+
+/*
+ * bytime - qsort order of block slots by the time of their last access
+ */
+static int bytime(const void *x, const void *y)
+{
+    const struct slot *a = *(const struct slot * const *)x;
+    const struct slot *b = *(const struct slot * const *)y;
+
+    return (a->a > b->a) - (a->a < b->a);
+}
+
+/*
+ * compact - renumber the last accesses of the live blocks 1..n in order
+ *     and rebuild the tree with room for as many accesses again
+ */
+static void compact(void)
+{
+    struct slot **live;
+    unsigned long i, j, n = 0;
+
+    if ((live = malloc((blocks.used + 1) * sizeof(struct slot *))) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i <= blocks.mask && blocks.slot != NULL; i++) {
+        if (blocks.slot[i].key != EMPTY)
+            live[n++] = &blocks.slot[i];
+    }
+    qsort(live, n, sizeof(struct slot *), bytime);
+    for (i = 0; i < n; i++)
+        live[i]->a = i + 1;
+    free(live);
+
+    treesize = 2 * n > MINTREE ? 2 * n : MINTREE;
+    free(tree);
+    if ((tree = calloc(treesize + 1, sizeof(unsigned int))) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    /* linear build: every time 1..n holds a one */
+    for (i = 1; i <= treesize; i++) {
+        tree[i] += i <= n;
+        if ((j = i + (i & -i)) <= treesize)
+            tree[j] += tree[i];
+    }
+    now = n;
+}
+
+/*
+ * bucket - histogram bucket of a reuse distance
+ */
+static int bucket(unsigned long d)
+{
+    return d == 0 ? 0 : 64 - __builtin_clzl(d);
+}
+
+/*
+ * printwindow - print the working set of a finished window
+ */
+static void printwindow(unsigned long win)
+{
+    printf("%-12lu %-12lu %lu\n", win, distinct, distinct << bbits);
+}
+
+/*
+ * profile - account one access to address
+ */
+static void profile(unsigned long address)
+{
+    struct slot *bl, *rg;
+    unsigned long d, win = window ? accesses / window : 0;
+    int first, miss;
+
+    if (now == treesize)
+        compact();
+    now++;
+
+    bl = mapget(&blocks, address >> bbits);
+    first = bl->a == 0;
+    if (first) {
+        cold++;
+        miss = 1;
+        d = 0;
+    } else {
+        d = treesum(now - 1) - treesum(bl->a);
+        hist[bucket(d)]++;
+        miss = d >= capacity;
+        treeadd(bl->a, -1);
+    }
+    treeadd(now, 1);
+    bl->a = now;
+
+    rg = mapget(&regions, address >> gbits);
+    rg->a++;
+    rg->b += miss;
+
+    /* working set: count the blocks touched in each window, b holds the
+     * last window of the block plus one */
+    if (window) {
+        if (accesses > 0 && accesses % window == 0) {
+            printwindow(win - 1);
+            distinct = 0;
+        }
+        if (bl->b != win + 1) {
+            distinct++;
+            bl->b = win + 1;
+        }
+    }
+    accesses++;
+}
+
+/*
+ * bymisses - qsort order of region slots, most misses first
+ */
+static int bymisses(const void *x, const void *y)
+{
+    const struct slot *a = x, *b = y;
+
+    if (a->b != b->b)
+        return (a->b < b->b) - (a->b > b->b);
+    return (a->a < b->a) - (a->a > b->a);
+}
+
+/*
+ * report - print the histogram and the busiest regions
+ */
+static void report(void)
+{
+    struct slot *rg;
+    unsigned long i, n = 0, sum = 0, misses = 0;
+    int k;
+
+    if (window && accesses > 0)
+        printwindow((accesses - 1) / window);
+
+    printf("\nReuse distance in %d-byte blocks, %lu accesses\n",
+           1 << bbits, accesses);
+    printf("%-24s %-12s %s\n", "distance", "count", "cumulative");
+    for (k = 0; k < NBUCKET; k++) {
+        char range[48];
+        if (hist[k] == 0)
+            continue;
+        sum += hist[k];
+        if (k <= 1)
+            sprintf(range, "%d", k);
+        else
+            sprintf(range, "%lu-%lu", 1UL << (k - 1), (1UL << k) - 1);
+        printf("%-24s %-12lu %.4f\n", range, hist[k],
+               (double)sum / accesses);
+    }
+    printf("%-24s %-12lu %.4f\n", "cold", cold,
+           (double)(sum + cold) / accesses);
+
+    if ((rg = malloc((regions.used + 1) * sizeof(struct slot))) == NULL)
+        return;
+    for (i = 0; i <= regions.mask && regions.slot != NULL; i++) {
+        if (regions.slot[i].key != EMPTY) {
+            rg[n++] = regions.slot[i];
+            misses += regions.slot[i].b;
+        }
+    }
+    qsort(rg, n, sizeof(struct slot), bymisses);
+    printf("\nMisses of a %lu-block fully associative LRU cache by %d-byte region\n",
+           capacity, 1 << gbits);
+    printf("%-20s %-12s %-12s %-10s %s\n",
+           "region", "accesses", "misses", "miss_rate", "of_misses");
+    for (i = 0; i < n && i < (unsigned long)ntop; i++) {
+        printf("0x%-18lx %-12lu %-12lu %-10.4f %.4f\n", rg[i].key << gbits,
+               rg[i].a, rg[i].b, (double)rg[i].b / rg[i].a,
+               misses ? (double)rg[i].b / misses : 0.0);
+    }
+    free(rg);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] [-b <b>] [-c <blocks>] [-w <accesses>] [-g <g>] [-n <n>] -t <tracefile>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h           Print this help message.\n");
+    printf("  -b <b>       Block offset bits (default 6).\n");
+    printf("  -c <blocks>  Cache capacity in blocks for misses (default 512).\n");
+    printf("  -w <n>       Working set window in accesses, 0 for none (default 10000).\n");
+    printf("  -g <g>       Region size is 2^g bytes (default 12).\n");
+    printf("  -n <n>       Regions to print (default 20).\n");
+    printf("  -t <file>    Trace to profile, text or binary (- for stdin).\n");
+    printf("Example: %s -c 16 -b 5 -t trace.f0\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char *file = NULL;
+    trace_ref_t ref;
+    trace_t *trace;
+    char c;
+
+    while ((c = getopt(argc, argv, "b:c:w:g:n:t:h")) != -1) {
+        switch (c) {
+        case 'b':
+            bbits = atoi(optarg);
+            break;
+        case 'c':
+            capacity = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            window = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            gbits = atoi(optarg);
+            break;
+        case 'n':
+            ntop = atoi(optarg);
+            break;
+        case 't':
+            file = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (file == NULL || bbits >= 64 || gbits >= 64) {
+        printf("Error: Missing or wrong argument\n");
+        usage(argv);
+        exit(1);
+    }
+    if ((trace = trace_open(file)) == NULL) {
+        fprintf(stderr, "Error: can not open %s\n", file);
+        exit(1);
+    }
+
+    if (window)
+        printf("Working set, windows of %lu accesses\n%-12s %-12s %s\n",
+               window, "window", "blocks", "bytes");
+    /* a modify is a load and a store, as in csim */
+    while (trace_next(trace, &ref)) {
+        if (ref.op == 'L' || ref.op == 'M')
+            profile(ref.addr);
+        if (ref.op == 'S' || ref.op == 'M')
+            profile(ref.addr);
+    }
+    trace_close(trace);
+    report();
+
+    free(tree);
+    free(blocks.slot);
+    free(regions.slot);
+    return 0;
+}
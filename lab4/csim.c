@@ -3,34 +3,673 @@
 
 
 #include "cachelab.h"
+#include "cache.h"
+#include "coherence.h"
+#include "tlb.h"
+#include "trace.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
-#include <limits.h>
+#include <pthread.h>
 
+//the simulator itself is in cache.c, this is its command line
 
-//use Bi-directional list to achieve LINE in SET
-struct node {
-    unsigned int valid;
-    unsigned long pos;
-    struct node *next;
-    struct node *pre;
+//accesses handed to a worker at a time, and batches queued per worker
+#define BATCH 4096
+#define QDEPTH 8
+#define MAXTHREAD 64
+
+static const char *classname[] = { "compulsory", "capacity", "conflict" };
+
+//levels given with -L, or the single cache of -s -E -b
+static cache_config_t levels[CACHE_MAXLEVEL];
+static int nlevels = 0;
+
+//the TLB of -T, NULL without one
+static tlb_t *tlb = NULL;
+
+//one cache access, a modify is two of them; write is -1 for the
+//instruction of the accesses after it, for the stride prefetcher
+struct access {
+    unsigned long addr;
+    int write;
+};
+
+/*
+ * translate - run a reference through the TLB and return the number of
+ *     page table entries its walk reads, into walk
+ */
+static int translate(const trace_ref_t *ref, unsigned long *walk)
+{
+    if (tlb == NULL || ref->op == 'I')
+        return 0;
+    return tlb_access(tlb, ref->addr, walk);
+}
+
+/*
+ * loadtrace - read the whole trace into an array of accesses, OPT has
+ *     to see the future. Page walks are loads before the access they
+ *     translate for. Returns the number of accesses or -1.
+ */
+static long loadtrace(trace_t *trace, struct access **out)
+{
+    struct access *a = NULL, *bigger;
+    unsigned long n = 0, size = 0, walk[TLB_MAXWALK];
+    trace_ref_t ref;
+    int k, nwalk;
+
+    while (trace_next(trace, &ref)) {
+        if (n + 2 + TLB_MAXWALK > size) {
+            size = size ? 2 * size : 1UL << 16;
+            if ((bigger = realloc(a, size * sizeof(*a))) == NULL) {
+                free(a);
+                return -1;
+            }
+            a = bigger;
+        }
+        if (ref.op == 'I') {
+            a[n].addr = ref.addr;
+            a[n++].write = -1;
+        }
+        nwalk = translate(&ref, walk);
+        for (k = 0; k < nwalk; k++) {
+            a[n].addr = walk[k];
+            a[n++].write = 0;
+        }
+        if (ref.op == 'L' || ref.op == 'M') {
+            a[n].addr = ref.addr;
+            a[n++].write = 0;
+        }
+        if (ref.op == 'S' || ref.op == 'M') {
+            a[n].addr = ref.addr;
+            a[n++].write = 1;
+        }
+    }
+    *out = a;
+    return n;
+}
+
+/*
+ * runplanned - simulate a loaded trace, telling the cache all of it
+ *     first so OPT levels know the future
+ */
+static int runplanned(cache_t *c, trace_t *trace)
+{
+    struct access *a;
+    unsigned long *addr;
+    long k, m = 0, n = loadtrace(trace, &a);
+    int rc = 0;
+
+    if (n < 0)
+        return -1;
+    if ((addr = malloc((n + 1) * sizeof(unsigned long))) == NULL) {
+        free(a);
+        return -1;
+    }
+    for (k = 0; k < n; k++) {
+        if (a[k].write >= 0)
+            addr[m++] = a[k].addr;
+    }
+    if (cache_plan(c, addr, m) < 0) {
+        free(addr);
+        free(a);
+        return -1;
+    }
+    for (k = 0; k < n; k++) {
+        if (a[k].write < 0)
+            cache_instruction(c, a[k].addr);
+        else if (cache_access(c, a[k].addr, 1,
+                              a[k].write ? CACHE_STORE : CACHE_LOAD) < 0)
+            rc = -1;
+    }
+    free(addr);
+    free(a);
+    return rc;
+}
+
+//a run of accesses for one worker
+struct batch {
+    unsigned int n;
+    struct access a[BATCH];
+};
+
+//a thread simulating the sets congruent to its index modulo nworkers,
+//in a cache of its own; no two workers see the same set. Set k of the
+//trace is set k / nworkers of the worker's cache, which has 2^wsets
+//sets, enough for its share.
+struct worker {
+    pthread_t tid;
+    cache_t *c;
+    pthread_mutex_t lock;
+    pthread_cond_t ready, drained;
+    struct batch *queue[QDEPTH];
+    unsigned int head, tail;    //taken and queued batch counts
+    int done;                   //no more batches will be queued
+    struct batch *cur;          //batch the reader is filling
+};
+
+static struct worker workers[MAXTHREAD];
+static int nworkers = 0;
+static unsigned int wsets;
+
+/*
+ * runworker - simulate batches in order until the reader is done
+ */
+static void *runworker(void *arg)
+{
+    struct worker *w = arg;
+    struct batch *bt;
+    unsigned int k;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->head == w->tail && !w->done)
+            pthread_cond_wait(&w->ready, &w->lock);
+        if (w->head == w->tail) {
+            pthread_mutex_unlock(&w->lock);
+            return NULL;
+        }
+        bt = w->queue[w->head % QDEPTH];
+        w->head++;
+        pthread_cond_signal(&w->drained);
+        pthread_mutex_unlock(&w->lock);
+
+        for (k = 0; k < bt->n; k++)
+            cache_access(w->c, bt->a[k].addr, 1,
+                         bt->a[k].write ? CACHE_STORE : CACHE_LOAD);
+        free(bt);
+    }
+}
+
+/*
+ * pushbatch - queue the reader's current batch of w, waiting while the
+ *     queue is full
+ */
+static void pushbatch(struct worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    while (w->tail - w->head == QDEPTH)
+        pthread_cond_wait(&w->drained, &w->lock);
+    w->queue[w->tail % QDEPTH] = w->cur;
+    w->tail++;
+    pthread_cond_signal(&w->ready);
+    pthread_mutex_unlock(&w->lock);
+    w->cur = NULL;
+}
+
+/*
+ * dispatch - append an access to the batch of the worker owning its set,
+ *     moved to that set's place in the worker's cache
+ */
+static int dispatch(unsigned long address, int write)
+{
+    unsigned int s = levels[0].s, b = levels[0].b;
+    unsigned long set = (address >> b) & ((1UL << s) - 1);
+    struct worker *w = &workers[set % nworkers];
+
+    address = (address >> (s + b)) << (wsets + b) |
+              (set / nworkers) << b | (address & ((1UL << b) - 1));
+
+    if (w->cur == NULL) {
+        if ((w->cur = malloc(sizeof(struct batch))) == NULL)
+            return -1;
+        w->cur->n = 0;
+    }
+    w->cur->a[w->cur->n].addr = address;
+    w->cur->a[w->cur->n].write = write;
+    if (++w->cur->n == BATCH)
+        pushbatch(w);
+    return 0;
+}
+
+/*
+ * stopworkers - queue what is left for the first n workers, wait for
+ *     them to finish and free them, adding up their counts in total
+ */
+static void stopworkers(int n, cache_stats_t *total)
+{
+    cache_stats_t st;
+    int i;
+
+    memset(total, 0, sizeof(cache_stats_t));
+    for (i = 0; i < n; i++) {
+        struct worker *w = &workers[i];
+        if (w->cur != NULL)
+            pushbatch(w);
+        pthread_mutex_lock(&w->lock);
+        w->done = 1;
+        pthread_cond_signal(&w->ready);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->tid, NULL);
+        cache_stats(w->c, 0, &st);
+        total->hits += st.hits;
+        total->misses += st.misses;
+        total->evictions += st.evictions;
+        total->writebacks += st.writebacks;
+        cache_free(w->c);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->ready);
+        pthread_cond_destroy(&w->drained);
+    }
+}
+
+/*
+ * runparallel - read the trace on this thread and simulate its sets on
+ *     n workers, then add up their counts in total. Accesses to one set
+ *     keep their order since a set always goes to the same worker.
+ *     Returns 0, -1 if the caches can not be built, or -2 if a thread
+ *     can not start or memory runs out.
+ */
+static int runparallel(trace_t *trace, int n, int policy, cache_stats_t *total)
+{
+    cache_config_t part = levels[0];
+    trace_ref_t ref;
+    int i, rc = 0, err = -1;
+
+    //the smallest power of two of sets holding the share of a worker
+    part.s = 0;
+    while ((1UL << part.s) * n < (1UL << levels[0].s))
+        part.s++;
+    wsets = part.s;
+
+    nworkers = n;
+    for (i = 0; i < n; i++) {
+        struct worker *w = &workers[i];
+        w->head = w->tail = 0;
+        w->done = 0;
+        w->cur = NULL;
+        if ((w->c = cache_create(&part, 1, policy)) == NULL)
+            break;
+        //random and BRRIP draw differently in every partition
+        cache_seed(w->c, i);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->ready, NULL);
+        pthread_cond_init(&w->drained, NULL);
+        if (pthread_create(&w->tid, NULL, runworker, w) != 0) {
+            err = -2;
+            cache_free(w->c);
+            pthread_mutex_destroy(&w->lock);
+            pthread_cond_destroy(&w->ready);
+            pthread_cond_destroy(&w->drained);
+            break;
+        }
+    }
+    if (i < n) {
+        stopworkers(i, total);
+        return err;
+    }
+
+    while (rc == 0 && trace_next(trace, &ref)) {
+        if (ref.op == 'L' || ref.op == 'M')
+            rc = dispatch(ref.addr, 0);
+        if (rc == 0 && (ref.op == 'S' || ref.op == 'M'))
+            rc = dispatch(ref.addr, 1);
+    }
+    stopworkers(n, total);
+    return rc < 0 ? -2 : 0;
+}
+
+//LRU stacks of every set of one (s, b) pair in a sweep, most recent
+//first and cut off at the largest E. A block at depth d hits every
+//cache of more than d ways; with no invalidations the set of an E way
+//cache holds min(E, len) blocks, which gives its evictions too.
+struct stacks {
+    unsigned int s, b;
+    unsigned long *tag;     //2^s rows of depth tags
+    unsigned int *len;      //blocks in each row
+    unsigned long *depth;   //depth of each hit, maxE for a miss at all E
+    unsigned long *full;    //depth of each hit, row length for a miss
 };
 
+//ranges of a sweep, E doubles from Elo to Ehi
+static unsigned int slo, shi, Elo, Ehi, blo, bhi, maxE;
+static struct stacks *stacks;
+static cache_t **sweepcache;
+static int nstacks, nsweepcache;
+static unsigned long accesses;
+
+/*
+ * parserange - parse "lo-hi" or a single value
+ */
+static char *parserange(char *p, unsigned int *lo, unsigned int *hi)
+{
+    char *end;
+
+    *lo = *hi = strtoul(p, &end, 10);
+    if (end == p)
+        return NULL;
+    if (*end == '-') {
+        p = end + 1;
+        *hi = strtoul(p, &end, 10);
+        if (end == p || *hi < *lo)
+            return NULL;
+    }
+    return end;
+}
+
+/*
+ * initsweep - parse a grid "s,E,b" of ranges and set up its caches:
+ *     stacks for LRU, one cache per point for other policies
+ */
+static int initsweep(char *spec, int policy)
+{
+    unsigned int s, E, b;
+    int i;
+
+    if ((spec = parserange(spec, &slo, &shi)) == NULL || *spec++ != ',' ||
+        (spec = parserange(spec, &Elo, &Ehi)) == NULL || *spec++ != ',' ||
+        (spec = parserange(spec, &blo, &bhi)) == NULL || *spec != '\0')
+        return -1;
+    if (Elo == 0 || shi + bhi >= 64 || policy == CACHE_OPT)
+        return -1;
+    for (maxE = Elo; 2 * maxE <= Ehi; maxE *= 2)
+        ;
+
+    if (policy == CACHE_LRU) {
+        nstacks = (shi - slo + 1) * (bhi - blo + 1);
+        if ((stacks = calloc(nstacks, sizeof(struct stacks))) == NULL)
+            return -1;
+        i = 0;
+        for (s = slo; s <= shi; s++) {
+            for (b = blo; b <= bhi; b++, i++) {
+                stacks[i].s = s;
+                stacks[i].b = b;
+                stacks[i].tag = malloc((1UL << s) * maxE * sizeof(unsigned long));
+                stacks[i].len = calloc(1UL << s, sizeof(unsigned int));
+                stacks[i].depth = calloc(maxE + 1, sizeof(unsigned long));
+                stacks[i].full = calloc(maxE + 1, sizeof(unsigned long));
+                if (stacks[i].tag == NULL || stacks[i].len == NULL ||
+                    stacks[i].depth == NULL || stacks[i].full == NULL)
+                    return -1;
+            }
+        }
+        return 0;
+    }
+
+    for (E = Elo; E <= maxE; E *= 2)
+        nsweepcache++;
+    nsweepcache *= (shi - slo + 1) * (bhi - blo + 1);
+    if ((sweepcache = calloc(nsweepcache, sizeof(cache_t *))) == NULL)
+        return -1;
+    i = 0;
+    for (s = slo; s <= shi; s++) {
+        for (E = Elo; E <= maxE; E *= 2) {
+            for (b = blo; b <= bhi; b++, i++) {
+                cache_config_t config = { s, E, b, policy, CACHE_NINE, 0 };
+                if ((sweepcache[i] = cache_create(&config, 1, policy)) == NULL)
+                    return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * sweepaccess - feed one access to every point of the sweep
+ */
+static void sweepaccess(unsigned long address, int write)
+{
+    struct stacks *st;
+    unsigned long set, tag, *row;
+    unsigned int d, n, keep;
+    int i;
+
+    accesses++;
+    for (i = 0; i < nstacks; i++) {
+        st = &stacks[i];
+        set = (address >> st->b) & ((1UL << st->s) - 1);
+        tag = (address >> st->b) >> st->s;
+        row = st->tag + set * maxE;
+        n = st->len[set];
+        for (d = 0; d < n && row[d] != tag; d++)
+            ;
+        if (d < n) {
+            st->depth[d]++;
+            st->full[d]++;
+            keep = d;
+        } else {
+            st->depth[maxE]++;
+            st->full[n]++;
+            keep = n < maxE ? n : maxE - 1;
+            if (n < maxE)
+                st->len[set]++;
+        }
+        memmove(row + 1, row, keep * sizeof(unsigned long));
+        row[0] = tag;
+    }
+
+    for (i = 0; i < nsweepcache; i++)
+        cache_access(sweepcache[i], address, 1, write ? CACHE_STORE : CACHE_LOAD);
+}
+
+/*
+ * printsweep - write one CSV row per point of the sweep
+ */
+static void printsweep(void)
+{
+    unsigned long hits, misses, evictions;
+    unsigned int s, E, b, d;
+    int i = 0;
+
+    printf("s,E,b,bytes,accesses,hits,misses,evictions,miss_rate\n");
+    for (s = slo; s <= shi; s++) {
+        for (E = Elo; E <= maxE; E *= 2) {
+            for (b = blo; b <= bhi; b++) {
+                if (nstacks > 0) {
+                    struct stacks *st = &stacks[(s - slo) * (bhi - blo + 1) + b - blo];
+                    hits = evictions = 0;
+                    for (d = 0; d < E; d++)
+                        hits += st->depth[d];
+                    for (d = E; d <= maxE; d++)
+                        evictions += st->full[d];
+                    misses = accesses - hits;
+                } else {
+                    cache_stats_t st;
+                    cache_stats(sweepcache[i++], 0, &st);
+                    hits = st.hits;
+                    misses = st.misses;
+                    evictions = st.evictions;
+                }
+                printf("%u,%u,%u,%lu,%lu,%lu,%lu,%lu,%.6f\n", s, E, b,
+                       (1UL << s) * E << b, accesses, hits, misses, evictions,
+                       accesses ? (double)misses / accesses : 0.0);
+            }
+        }
+    }
+}
+
+/*
+ * runsweep - simulate the whole grid in one pass over the trace
+ */
+static int runsweep(trace_t *trace)
+{
+    trace_ref_t ref;
+    int i;
+
+    while (trace_next(trace, &ref)) {
+        if (ref.op == 'L' || ref.op == 'M')
+            sweepaccess(ref.addr, 0);
+        if (ref.op == 'S' || ref.op == 'M')
+            sweepaccess(ref.addr, 1);
+    }
+    printsweep();
+
+    for (i = 0; i < nstacks; i++) {
+        free(stacks[i].tag);
+        free(stacks[i].len);
+        free(stacks[i].depth);
+        free(stacks[i].full);
+    }
+    for (i = 0; i < nsweepcache; i++)
+        cache_free(sweepcache[i]);
+    free(stacks);
+    free(sweepcache);
+    return 0;
+}
+
+/*
+ * printclasses - print the miss classes of a level, and of its busiest
+ *     regions when asked for
+ */
+static void printclasses(const char *prefix, cache_t *c, int level)
+{
+    const cache_region_t *rg;
+    cache_stats_t st;
+    unsigned long k, n;
+    int j;
+
+    cache_stats(c, level, &st);
+    printf("%s", prefix);
+    for (j = 0; j < 3; j++)
+        printf("%s:%lu%c", classname[j], st.classes[j], j < 2 ? ' ' : '\n');
+    rg = cache_regions(c, level, &n);
+    for (k = 0; k < n && k < 20; k++) {
+        printf("%s  region 0x%lx", prefix, rg[k].region);
+        for (j = 0; j < 3; j++)
+            printf(" %s:%lu", classname[j], rg[k].count[j]);
+        printf("\n");
+    }
+}
+
+/*
+ * printprefetch - print what became of the prefetches of a level
+ */
+static void printprefetch(const char *prefix, cache_t *c, int level)
+{
+    cache_stats_t st;
+
+    cache_stats(c, level, &st);
+    printf("%sprefetches:%lu useful:%lu late:%lu useless:%lu\n", prefix,
+           st.prefetches, st.useful, st.late, st.useless);
+}
 
+/*
+ * printtlb - print the counts of the TLB and its page walks
+ */
+static void printtlb(void)
+{
+    tlb_stats_t st;
+
+    tlb_stats(tlb, &st);
+    printf("TLB 4K hits:%lu misses:%lu 2M hits:%lu misses:%lu",
+           st.hits[TLB_L1], st.misses[TLB_L1],
+           st.hits[TLB_L1_HUGE], st.misses[TLB_L1_HUGE]);
+    printf(" L2 hits:%lu misses:%lu\n", st.hits[TLB_L2], st.misses[TLB_L2]);
+    printf("page walks 4K:%lu 2M:%lu entries read:%lu\n",
+           st.walks[0], st.walks[1], st.walkrefs);
+}
+
+/*
+ * runcoherence - simulate the trace on cores private caches of one
+ *     geometry, thread k running on core k % cores, and print the
+ *     counts of every core, of the bus and the false sharing lines
+ */
+static int runcoherence(trace_t *trace, const cache_config_t *cfg,
+                        int cores, int protocol)
+{
+    coh_t *c = coh_create(cores, cfg->s, cfg->E, cfg->b, protocol);
+    coh_core_stats_t cs;
+    coh_bus_stats_t bs;
+    coh_line_t top[10];
+    trace_ref_t ref;
+    int k, n, core;
+
+    if (c == NULL)
+        return -1;
+    while (trace_next(trace, &ref)) {
+        if (ref.op == 'I')
+            continue;
+        core = (unsigned int)ref.thread % cores;
+        //a modify reads and then writes the same bytes
+        if (ref.op == 'L' || ref.op == 'M')
+            coh_access(c, core, ref.addr, ref.size, 0);
+        if (ref.op == 'S' || ref.op == 'M')
+            coh_access(c, core, ref.addr, ref.size, 1);
+    }
+
+    for (k = 0; k < cores; k++) {
+        coh_core_stats(c, k, &cs);
+        printf("core %d hits:%lu misses:%lu evictions:%lu coherence:%lu"
+               " invalidated:%lu\n", k, cs.hits, cs.misses, cs.evictions,
+               cs.coherence, cs.invalidated);
+    }
+    coh_bus_stats(c, &bs);
+    printf("bus reads:%lu readx:%lu upgrades:%lu invalidations:%lu"
+           " transfers:%lu writebacks:%lu\n", bs.reads, bs.readx,
+           bs.upgrades, bs.invalidations, bs.transfers, bs.writebacks);
+    printf("sharing true:%lu false:%lu\n", bs.truesharing, bs.falsesharing);
+    n = coh_falsesharing(c, top, 10);
+    for (k = 0; k < n; k++)
+        printf("  line 0x%lx false:%lu true:%lu invalidations:%lu cores:0x%lx\n",
+               top[k].addr, top[k].falsesharing, top[k].truesharing,
+               top[k].invalidations, top[k].cores);
+    coh_free(c);
+    return 0;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char *argv[]){
+    printf("Usage: %s [-h] [-r <policy>] -s <s> -E <E> -b <b> -t <tracefile>\n",
+           argv[0]);
+    printf("       %s [-h] [-r <policy>] -L <level> [-L <level>...] -t <tracefile>\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -s <s>      Number of set index bits.\n");
+    printf("  -E <E>      Number of lines per set.\n");
+    printf("  -b <b>      Number of block offset bits.\n");
+    printf("  -L <level>  Add a cache level below the previous ones, given as\n");
+    printf("              s,E,b[,inclusive|exclusive|nine][,wb|wt][,<policy>]\n");
+    printf("              (default nine and wb: write-back, write-allocate;\n");
+    printf("              wt is write-through, no-write-allocate)\n");
+    printf("  -r <policy> Replacement policy of levels without their own:\n");
+    printf("              lru (default), plru, srrip, brrip, random, fifo,\n");
+    printf("              or opt (Belady, reads the whole trace first)\n");
+    printf("  -S <grid>   Sweep every cache of the grid \"s,E,b\" in one pass and\n");
+    printf("              print a CSV; each is a value or a range lo-hi, E\n");
+    printf("              doubles from lo to hi (e.g. 0-10,1-16,4-6).\n");
+    printf("  -c          Classify misses as compulsory, capacity or conflict.\n");
+    printf("  -g <g>      With -c, also by region of 2^g bytes (top 20).\n");
+    printf("  -j <n>      Split the sets of a single level cache over n threads.\n");
+    printf("  -P <pf>     Prefetch into L1, given as\n");
+    printf("              nextline|stride|stream[,degree[,distance[,latency]]]\n");
+    printf("              (blocks per trigger and how far ahead, default 1,1;\n");
+    printf("              stride uses the I lines of the trace; a use within\n");
+    printf("              latency L1 accesses of the prefetch is late, default 0)\n");
+    printf("  -T <tlb>    Translate through a TLB, \"default\" or the entries\n");
+    printf("              and ways of the L1 4K, L1 2M and L2 (shared) arrays,\n");
+    printf("              e,w[,e,w[,e,w]] over 64,4,32,4,1536,12 (0 for no\n");
+    printf("              L2); page walks read their entries through the cache.\n");
+    printf("  -H <lo-hi>  With -T, map hex addresses [lo, hi) with 2M pages,\n");
+    printf("              or all of them for \"all\"; may be repeated.\n");
+    printf("  -C <n>      Run the threads of the trace (T lines) on n cores with\n");
+    printf("              private caches of the single level, kept coherent by\n");
+    printf("              n,mesi (default) or n,moesi; reports false sharing.\n");
+    printf("  -t <file>   Trace to simulate, text or binary (- for stdin).\n");
+    printf("Example: %s -L 6,8,6 -L 10,16,6,inclusive -t traces/long.trace\n",
+           argv[0]);
+}
 
 int main(int argc, char* argv[]){
-    unsigned int hits=0, misses=0, evictions=0;
     unsigned int s=0, E=0, b=0;
-    char *t = NULL;
-    unsigned int set=0;
-    unsigned long tag=0,offset=0;
-    int option;
+    char *t = NULL, *grid = NULL;
+    int option, i, policy = CACHE_LRU, threads = 1;
+    int classifying = 0, regionbits = -1;
+    cache_prefetch_t pf = { CACHE_PF_NONE, 1, 1, 0 };
+    tlb_config_t tlbcfg;
+    char *huge[64];
+    int usetlb = 0, nhuge = 0;
+    int cores = 0, protocol = COH_MESI;
+    cache_stats_t st;
+    cache_t *cache = NULL;
+    tlb_default(&tlbcfg);
     //Specifying the expected options
     //read parameters from the command line
-    while ((option = getopt(argc, argv,"s:E:b:t:")) != -1) {
+    while ((option = getopt(argc, argv,"s:E:b:t:L:r:j:S:P:T:H:C:cg:h")) != -1) {
         switch (option) {
             case 's' : s = atoi(optarg);
                 break;
@@ -40,239 +679,268 @@ int main(int argc, char* argv[]){
                 break;
             case 't' : t = optarg;
                 break;
+            case 'L' :
+                //victims move between exclusive levels whole
+                if(nlevels >= CACHE_MAXLEVEL ||
+                   cache_parse_level(optarg, &levels[nlevels]) < 0 ||
+                   (levels[nlevels].inclusion == CACHE_EXCLUSIVE &&
+                    (nlevels == 0 || levels[nlevels-1].b != levels[nlevels].b))){
+                    printf("wrong cache level %s\n", optarg);
+                    return -1;
+                }
+                nlevels++;
+                break;
+            case 'r' :
+                if((policy = cache_parse_policy(optarg)) < 0){
+                    printf("wrong policy %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'j' : threads = atoi(optarg);
+                if(threads < 1 || threads > MAXTHREAD){
+                    printf("wrong thread count %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'S' : grid = optarg;
+                break;
+            case 'P' :
+                if(cache_parse_prefetch(optarg, &pf) < 0){
+                    printf("wrong prefetcher %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'T' :
+                if(tlb_parse(optarg, &tlbcfg) < 0){
+                    printf("wrong TLB %s\n", optarg);
+                    return -1;
+                }
+                usetlb = 1;
+                break;
+            case 'H' :
+                if(nhuge == 64){
+                    printf("too many -H\n");
+                    return -1;
+                }
+                huge[nhuge++] = optarg;
+                break;
+            case 'C' : {
+                char *p = strchr(optarg, ',');
+                cores = atoi(optarg);
+                if(cores < 1 || cores > COH_MAXCORES ||
+                   (p != NULL && (protocol = coh_parse_protocol(p + 1)) < 0)){
+                    printf("wrong cores %s\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case 'c' : classifying = 1;
+                break;
+            case 'g' : regionbits = atoi(optarg);
+                if(regionbits < 0 || regionbits >= 64){
+                    printf("wrong region size %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'h' : usage(argv);
+                return 0;
             default:
-                 printf ("?? getopt returned character code 0%o ??\n", option);
+                usage(argv);
+                return -1;
         }
     }
-    
-    //arrange parameters
-    int sets = 1<<s;
-    struct node *temp;
-
-    //use node** to implement an array of bidirectional node rings.
-    int i,j;
-    struct node **root = NULL;
-    root = (struct node **)malloc(sets * sizeof(struct node*));
-    //each head of the ring
-    for(i = 0; i < sets; ++i){
-        root[i] = malloc(sizeof(struct node));
-        root[i]->pos = 0;
-        root[i]->valid = 0;
-    }
-    //detail implementtion of nodes in rings, link them
-    for(i = 0; i < sets; ++i){
-        temp = root[i];
-        for(j = 0; j < E-1; ++j){
-            struct node *new = malloc(sizeof(struct node));
-            new->pos = 0;
-            new->valid = 0;
-            temp->next = new;
-            new->pre = temp;
-            temp = temp->next;
-        }
-        temp->next = root[i];
-        root[i]->pre = temp;
-    }
- 
-    
-    
-    FILE * pFile; //pointer to FILE object
-    if(strlen(t)==0){
+
+    if(t==NULL || strlen(t)==0){
         printf("wrong file address\n");
         return -1;
     }
-  
-    pFile = fopen (t,"r"); //open file for reading
-    if(pFile==NULL){
-        printf(" file can not open\n");
+
+    //a sweep replaces the single cache or hierarchy
+    if(grid != NULL){
+        if(classifying || pf.kind != CACHE_PF_NONE || usetlb || cores){
+            printf("-c, -P, -T and -C can not be used with -S\n");
+            return -1;
+        }
+        if(initsweep(grid, policy) < 0){
+            printf("wrong sweep grid %s\n", grid);
+            return -1;
+        }
+        trace_t *trace = trace_open(t);
+        if(trace==NULL){
+            printf(" file can not open\n");
+            return -1;
+        }
+        runsweep(trace);
+        trace_close(trace);
+        return 0;
+    }
+
+    //without -L, simulate the single cache given by -s -E -b
+    int hierarchy = nlevels > 0;
+    if(!hierarchy){
+        char spec[64];
+        sprintf(spec, "%u,%u,%u", s, E, b);
+        if(cache_parse_level(spec, &levels[0]) < 0){
+            printf("wrong cache parameters\n");
+            return -1;
+        }
+        nlevels = 1;
+    }
+    //every core gets a private copy of the one level
+    if(cores){
+        if(nlevels > 1 || classifying || pf.kind != CACHE_PF_NONE || usetlb ||
+           threads > 1 || nhuge > 0 ||
+           (levels[0].policy < 0 ? policy : levels[0].policy) != CACHE_LRU){
+            printf("-C needs a single LRU level without -c, -P, -T or -j\n");
+            return -1;
+        }
+        trace_t *trace = trace_open(t);
+        if(trace==NULL){
+            printf(" file can not open\n");
+            return -1;
+        }
+        if(runcoherence(trace, &levels[0], cores, protocol) < 0){
+            printf("wrong cache parameters\n");
+            return -1;
+        }
+        trace_close(trace);
+        return 0;
+    }
+    //OPT looks at the whole trace first
+    int planned = 0;
+    for(i = 0; i < nlevels; i++){
+        if((levels[i].policy < 0 ? policy : levels[i].policy) == CACHE_OPT)
+            planned = 1;
+    }
+    //sets are only independent within one level, OPT, the shadows,
+    //the prefetchers and the TLB are shared between sets
+    if(threads > 1 && (nlevels > 1 || planned || classifying ||
+                       pf.kind != CACHE_PF_NONE || usetlb)){
+        printf("-j needs a single level without opt, -c, -P or -T\n");
         return -1;
     }
-    //using mask to draw out the tag and set information
-    offset = (1<<b)-0x1;
-    unsigned long setmask = ( (1<<b)<<s)-0x1 - offset;
-    unsigned long tagmask = ULONG_MAX-setmask-offset;
-    char identifier;
-    unsigned long address;
-    int size;
-    int flag = 0;
-    // Reading lines like " M 20,1" or "L 19,3"
-    while(fscanf(pFile," %c %lx,%d", &identifier, &address, &size)>0)
-    {
-        if(identifier=='I'){
-            continue;
+    //with -j the workers build caches of their own sets only
+    if(threads == 1 && (cache = cache_create(levels, nlevels, policy)) == NULL){
+        printf("wrong cache parameters\n");
+        return -1;
+    }
+    if(classifying && cache_classify(cache, regionbits) < 0){
+        printf("out of memory\n");
+        return -1;
+    }
+    if(threads == 1 && cache_prefetch(cache, 0, &pf) < 0){
+        printf("out of memory\n");
+        return -1;
+    }
+    if(nhuge > 0 && !usetlb){
+        printf("-H needs -T\n");
+        return -1;
+    }
+    if(usetlb){
+        if((tlb = tlb_create(&tlbcfg)) == NULL){
+            printf("wrong TLB parameters\n");
+            return -1;
         }
-        //get tag and set for this line
-        tag = (address & tagmask)>>b>>s;
-        set = (int)(address & setmask)>>b;
-      
-
-        //reset the flag and start point
-        flag = 0;
-        temp = root[set];
-      //for the command S and L
-        if(identifier=='S'||identifier=='L'){
-         
-            for(i=0;i<E;i++){
-                
-                
-                //printf("pos%lx\n",temp->pos);
-                //check if hit, roll the ring for one node
-                if(temp->pos == tag&&temp->valid==1){
-                    
-                    
-                    hits = hits + 1;
-                    flag = 1;
-                    
-                    if(temp==root[set]){
-                        root[set] = root[set]->next;
-                        break;
-                    }
-                    temp->next->pre = temp->pre;
-                    temp->pre->next = temp->next;
-                    
-                    root[set]->pre->next = temp;
-                    temp->pre = root[set]->pre;
-                    root[set]->pre = temp;
-                    
-                    temp->next = root[set];
-                    
-                    break;
-                }
-                temp = temp->next;
-                
-                
+        for(i = 0; i < nhuge; i++){
+            unsigned long lo = 0, hi = ~0UL;
+            int len = 0;
+            if(strcmp(huge[i], "all") != 0 &&
+               (sscanf(huge[i], "%lx-%lx%n", &lo, &hi, &len) != 2 ||
+                huge[i][len] != '\0' || lo >= hi)){
+                printf("wrong page range %s\n", huge[i]);
+                return -1;
             }
-            
-            //hit and continue!
-            if(flag == 1){
-
-                continue ;}
-            else{
-                //check if there is more empty invalid block in line
-                temp = root[set];
-                for(i=0;i<E;i++){
-                    if(temp->valid ==0){
-                        misses = misses + 1;
-                        temp->pos = tag;
-                        temp->valid = 1;
-                        flag = 1;
-                        root[set]=root[set]->next;
-                        
-                        break;
-                    }
-                    temp = temp->next;
-                    
-                }
-                if(flag == 1){
-                    // printf("empty space!");
-                    //using empty space
-                    continue ;
-                }
-                //miss, evict the head of ring, load new block,
-                //and move the start of ring to next one
-                evictions = evictions + 1;
-                misses = misses + 1;
-                root[set]->pos = tag;
-                root[set]->valid = 1;
-                root[set] = root[set]->next;
+            if(tlb_hugepages(tlb, lo, hi) < 0){
+                printf("out of memory\n");
+                return -1;
             }
         }
-        //for situation with command M, we do the same as previously
-        else if(identifier=='M'){
-            flag = 0;
-            temp = root[set];
-            
-            for(i=0;i<E;i++){
-        
-                
-                //printf("pos%lx\n",temp->pos);
-                if(temp->pos == tag&&temp->valid==1){
-                    
-                    
-                    hits = hits + 2;
-                    flag = 1;
-                    
-                    if(temp==root[set]){
-                        root[set] = root[set]->next;
-                        break;
-                    }
-                    temp->next->pre = temp->pre;
-                    temp->pre->next = temp->next;
-                    
-                    root[set]->pre->next = temp;
-                    temp->pre = root[set]->pre;
-                    root[set]->pre = temp;
-                    
-                    temp->next = root[set];
-                    
-                    break;
-                }
-                temp = temp->next;
-       
+    }
+
+    //open the trace, "-" streams it from stdin
+    trace_t *trace = trace_open(t);
+    if(trace==NULL){
+        printf(" file can not open\n");
+        return -1;
+    }
+
+    if(threads > 1){
+        int rc = runparallel(trace, threads, policy, &st);
+        if(rc < 0){
+            printf(rc == -1 ? "wrong cache parameters\n" :
+                   "can not start the simulation threads\n");
+            return -1;
+        }
+    }
+    else if(planned){
+        if(runplanned(cache, trace) < 0){
+            printf("out of memory\n");
+            return -1;
+        }
+    }
+    else{
+        trace_ref_t ref;
+        unsigned long walk[TLB_MAXWALK];
+        int k, nwalk, rc = 0;
+        // Reading lines like " M 20,1" or "L 19,3"
+        while(trace_next(trace, &ref))
+        {
+            //the page walk of a TLB miss reads its entries first
+            nwalk = translate(&ref, walk);
+            for(k = 0; k < nwalk; k++)
+                rc |= cache_access(cache, walk[k], 1, CACHE_LOAD);
+            //a modify is a load followed by a store to the same block,
+            //and like csim-ref the size is ignored
+            if(ref.op=='L'){
+                rc |= cache_access(cache, ref.addr, 1, CACHE_LOAD);
             }
-            //hit!
-            //printf("%d,%d,%d",hits,misses,evictions);
-            if(flag == 1){ continue ;}
-            else{
-                temp = root[set];
-                for(i=0;i<E;i++){
-                    if(temp->valid ==0){
-                        misses = misses + 1;
-                        hits = hits + 1;
-                        temp->pos = tag;
-                        temp->valid = 1;
-                        flag = 1;
-                        root[set]=root[set]->next;
-                        break;
-                    }
-                    temp = temp->next;
-                    
-                }
-                if(flag == 1){
-                    continue ;
-                }
-                
-                evictions = evictions + 1;
-                misses = misses + 1;
-                hits = hits + 1;
-                root[set]->pos = tag;
-                root[set]->valid = 1;
-                root[set] = root[set]->next;
-                
+            else if(ref.op=='S'){
+                rc |= cache_access(cache, ref.addr, 1, CACHE_STORE);
+            }
+            else if(ref.op=='M'){
+                rc |= cache_access(cache, ref.addr, 1, CACHE_MODIFY);
+            }
+            else if(ref.op=='I'){
+                cache_instruction(cache, ref.addr);
             }
         }
-        else{
-            continue;
+        //classifying stops when its shadows can not grow
+        if(rc < 0){
+            printf("out of memory\n");
+            return -1;
         }
     }
     //remember to close file when done
-    fclose(pFile);
-    //free the cache
-    for(i = 0; i < sets; ++i){
-        temp = root[i];
-    
-        while(temp->next!=NULL){
-            if(temp->next==temp){
-                free(temp);
-                temp = NULL;
-                break;
-            }
-            temp->next->pre = temp->pre;
-            temp->pre->next = temp->next;
-            free(temp);
-            temp = temp->next;
-            
-            
+    trace_close(trace);
+
+    //out put results
+    if(hierarchy){
+        for(i = 0; i < nlevels; i++){
+            //-j has a single level, whose counts the workers added up
+            if(threads == 1)
+                cache_stats(cache, i, &st);
+            printf("L%d hits:%lu misses:%lu evictions:%lu writebacks:%lu\n",
+                   i + 1, st.hits, st.misses, st.evictions, st.writebacks);
+            char prefix[16];
+            sprintf(prefix, "L%d ", i + 1);
+            if(classifying)
+                printclasses(prefix, cache, i);
+            if(i == 0 && pf.kind != CACHE_PF_NONE)
+                printprefetch(prefix, cache, i);
         }
     }
-    free(root);
-    
-    
-    //out put results
-    printSummary(hits, misses, evictions);
+    else{
+        if(threads == 1)
+            cache_stats(cache, 0, &st);
+        printSummary(st.hits, st.misses, st.evictions);
+        if(classifying)
+            printclasses("", cache, 0);
+        if(pf.kind != CACHE_PF_NONE)
+            printprefetch("", cache, 0);
+    }
+    if(usetlb)
+        printtlb();
+    tlb_free(tlb);
+    cache_free(cache);
     return 0;
-    
-    
-    
-    
 }
@@ -0,0 +1,80 @@
+/*
+ * gtrans.c - Transpose kernels for 1, 2, 4, 8 and 16-byte elements
+ *
+ * GTRANS_DEFINE generates a blocked kernel for one element type. The
+ * tile side is chosen per width so that a tile row is one 64-byte line:
+ * a tile of A and its image in B then take 2 * T lines, which stay in
+ * L1 while the tile is copied. Whole tiles go through a loop with
+ * constant bounds, which the compiler unrolls and vectorizes for each
+ * width; the partial tiles at the right and bottom edges use the
+ * general loop.
+ */
+#include "gtrans.h"
+
+/* Bytes per cache line the tiles are sized for */
+#define LINE 64
+
+#define GTRANS_DEFINE(name, type)                                          \
+static void name##_tile(const type *restrict A, size_t lda,                \
+                        type *restrict B, size_t ldb)                      \
+{                                                                          \
+    size_t i, j;                                                           \
+                                                                           \
+    for (i = 0; i < LINE / sizeof(type); i++)                              \
+        for (j = 0; j < LINE / sizeof(type); j++)                          \
+            B[j * ldb + i] = A[i * lda + j];                               \
+}                                                                          \
+                                                                           \
+void name(size_t rows, size_t cols, const type *A, size_t lda,             \
+          type *B, size_t ldb)                                             \
+{                                                                          \
+    const size_t T = LINE / sizeof(type);                                  \
+    size_t i0, j0, i, j, i1, j1;                                           \
+                                                                           \
+    for (i0 = 0; i0 < rows; i0 += T) {                                     \
+        i1 = i0 + T < rows ? i0 + T : rows;                                \
+        for (j0 = 0; j0 < cols; j0 += T) {                                 \
+            j1 = j0 + T < cols ? j0 + T : cols;                            \
+            if (i1 - i0 == T && j1 - j0 == T) {                            \
+                name##_tile(A + i0 * lda + j0, lda, B + j0 * ldb + i0, ldb); \
+                continue;                                                  \
+            }                                                              \
+            for (i = i0; i < i1; i++)                                      \
+                for (j = j0; j < j1; j++)                                  \
+                    B[j * ldb + i] = A[i * lda + j];                       \
+        }                                                                  \
+    }                                                                      \
+}
+
+GTRANS_DEFINE(gtrans_u8, uint8_t)
+GTRANS_DEFINE(gtrans_u16, uint16_t)
+GTRANS_DEFINE(gtrans_u32, uint32_t)
+GTRANS_DEFINE(gtrans_u64, uint64_t)
+GTRANS_DEFINE(gtrans_u128, gtrans_u128_t)
+
+/*
+ * gtrans - dispatch on the element size
+ */
+int gtrans(size_t size, size_t rows, size_t cols, const void *A, size_t lda,
+           void *B, size_t ldb)
+{
+    switch (size) {
+    case 1:
+        gtrans_u8(rows, cols, A, lda, B, ldb);
+        return 0;
+    case 2:
+        gtrans_u16(rows, cols, A, lda, B, ldb);
+        return 0;
+    case 4:
+        gtrans_u32(rows, cols, A, lda, B, ldb);
+        return 0;
+    case 8:
+        gtrans_u64(rows, cols, A, lda, B, ldb);
+        return 0;
+    case 16:
+        gtrans_u128(rows, cols, A, lda, B, ldb);
+        return 0;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * gtrans.h - Transpose for any element width and layout
+ *
+ * Matrices are given as a base pointer and a leading dimension, the
+ * distance between rows in elements, so a sub-matrix is just a pointer
+ * into a larger one (see GTRANS_AT) with the larger one's leading
+ * dimension. There is one kernel per element width, each generated from
+ * the same macro in gtrans.c with its own tile size.
+ */
+
+#ifndef CACHELAB_GTRANS_H
+#define CACHELAB_GTRANS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 16-byte element, copied as a whole */
+typedef struct gtrans_u128 {
+    uint64_t w[2];
+} gtrans_u128_t;
+
+/* Address of element (i, j) of a matrix of size-byte elements */
+#define GTRANS_AT(base, ld, size, i, j) \
+    ((void *)((char *)(base) + ((size_t)(i) * (ld) + (j)) * (size)))
+
+/*
+ * gtrans_uN - B = A^T for rows x cols matrix A with leading dimension
+ *     lda, into cols x rows matrix B with leading dimension ldb. A and B
+ *     must not overlap.
+ */
+void gtrans_u8(size_t rows, size_t cols, const uint8_t *A, size_t lda,
+               uint8_t *B, size_t ldb);
+void gtrans_u16(size_t rows, size_t cols, const uint16_t *A, size_t lda,
+                uint16_t *B, size_t ldb);
+void gtrans_u32(size_t rows, size_t cols, const uint32_t *A, size_t lda,
+                uint32_t *B, size_t ldb);
+void gtrans_u64(size_t rows, size_t cols, const uint64_t *A, size_t lda,
+                uint64_t *B, size_t ldb);
+void gtrans_u128(size_t rows, size_t cols, const gtrans_u128_t *A,
+                 size_t lda, gtrans_u128_t *B, size_t ldb);
+
+/*
+ * gtrans - the same for size-byte elements, size 1, 2, 4, 8 or 16.
+ *     Returns 0 on success, -1 for any other size.
+ */
+int gtrans(size_t size, size_t rows, size_t cols, const void *A, size_t lda,
+           void *B, size_t ldb);
+
+#endif /* CACHELAB_GTRANS_H */
@@ -0,0 +1,116 @@
+/*
+ * memtrace.c - In-process memory tracer for the transpose functions
+ *
+ * Defines the hooks that -fsanitize=thread instrumentation calls on
+ * every load and store. While tracing, those that fall inside the traced
+ * range go through an LRU cache of the cache.c library, the model of
+ * csim; as with csim, the size of an access is ignored.
+ */
+#include <stdlib.h>
+#include "cache.h"
+#include "memtrace.h"
+
+static int tracing = 0;
+static unsigned long lo, hi;
+static cache_t *cache;
+
+/*
+ * record - run one access through the cache if it is in the traced range
+ */
+static void record(const void *p, int type)
+{
+    unsigned long addr = (unsigned long)p;
+
+    if (addr >= lo && addr < hi)
+        cache_access(cache, addr, 1, type);
+}
+
+/*
+ * memtrace_attach - start tracing into a cache owned by the caller
+ */
+void memtrace_attach(cache_t *c, const void *start, const void *end)
+{
+    cache = c;
+    lo = (unsigned long)start;
+    hi = (unsigned long)end;
+    tracing = 1;
+}
+
+/*
+ * memtrace_detach - stop tracing, the cache is left as it is
+ */
+void memtrace_detach(void)
+{
+    tracing = 0;
+    cache = NULL;
+}
+
+/*
+ * memtrace_start - create an empty cache and start tracing
+ */
+int memtrace_start(unsigned int s, unsigned int E, unsigned int b,
+                   const void *start, const void *end)
+{
+    cache_config_t config = { s, E, b, CACHE_LRU, CACHE_NINE, 0 };
+    cache_t *c;
+
+    if ((c = cache_create(&config, 1, CACHE_LRU)) == NULL)
+        return -1;
+    memtrace_attach(c, start, end);
+    return 0;
+}
+
+/*
+ * memtrace_stop - stop tracing, report and free the cache
+ */
+void memtrace_stop(unsigned int *hits, unsigned int *misses,
+                   unsigned int *evictions)
+{
+    cache_t *c = cache;
+    cache_stats_t st;
+
+    memtrace_detach();
+    cache_stats(c, 0, &st);
+    *hits = st.hits;
+    *misses = st.misses;
+    *evictions = st.evictions;
+    cache_free(c);
+}
+
+/*
+ * Instrumentation hooks. A read-modify-write calls both a read and a
+ * write hook, so it counts twice, like a lackey "M" line in csim.
+ */
+#define HOOKS(n)                                                        \
+    void __tsan_read##n(void *p)                                        \
+        { if (tracing) record(p, CACHE_LOAD); }                         \
+    void __tsan_write##n(void *p)                                       \
+        { if (tracing) record(p, CACHE_STORE); }                        \
+    void __tsan_unaligned_read##n(void *p)                              \
+        { if (tracing) record(p, CACHE_LOAD); }                         \
+    void __tsan_unaligned_write##n(void *p)                             \
+        { if (tracing) record(p, CACHE_STORE); }
+
+HOOKS(1)
+HOOKS(2)
+HOOKS(4)
+HOOKS(8)
+HOOKS(16)
+
+void __tsan_read_range(void *p, unsigned long size)
+{
+    (void)size;
+    if (tracing)
+        record(p, CACHE_LOAD);
+}
+
+void __tsan_write_range(void *p, unsigned long size)
+{
+    (void)size;
+    if (tracing)
+        record(p, CACHE_STORE);
+}
+
+void __tsan_func_entry(void *pc) { (void)pc; }
+void __tsan_func_exit(void) {}
+void __tsan_init(void) {}
@@ -0,0 +1,40 @@
+/*
+ * memtrace.h - Prototypes for the in-process memory tracer used by
+ *     test-trans
+ *
+ * trans.c is also built as trans-traced.o with -fsanitize=thread, which
+ * makes the compiler call a __tsan_readN or __tsan_writeN hook before
+ * every load and store. memtrace.c defines those hooks itself, without
+ * the ThreadSanitizer runtime, and feeds the accesses straight into a
+ * cache model, so no valgrind run or trace file is needed. The malloc
+ * lab's mdriver-cache traces mm.c the same way.
+ */
+
+#ifndef CACHELAB_MEMTRACE_H
+#define CACHELAB_MEMTRACE_H
+
+#include "cache.h"
+
+/*
+ * memtrace_start - Simulate an LRU cache with 2^s sets of E lines of
+ *     2^b bytes on every traced access to [lo, hi), until memtrace_stop.
+ *     Returns 0 on success, -1 if the cache can not be allocated.
+ */
+int memtrace_start(unsigned int s, unsigned int E, unsigned int b,
+                   const void *lo, const void *hi);
+
+/* memtrace_stop - Stop tracing and report the counts of the cache */
+void memtrace_stop(unsigned int *hits, unsigned int *misses,
+                   unsigned int *evictions);
+
+/*
+ * memtrace_attach - Send every traced access to [lo, hi) into cache c
+ *     until memtrace_detach. The caller creates and frees c, and may add
+ *     accesses of its own to it in between.
+ */
+void memtrace_attach(cache_t *c, const void *lo, const void *hi);
+
+/* memtrace_detach - Stop tracing, leaving the cache and its counts */
+void memtrace_detach(void);
+
+#endif /* CACHELAB_MEMTRACE_H */
@@ -0,0 +1,132 @@
+/*
+ * ptbench.c - Measure how the multi-threaded transpose in ptrans.c
+ *     scales, in GB/s for 1, 2, 4, ... threads up to the number of CPUs
+ *     this process may run on
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <getopt.h>
+#include <time.h>
+#include "ptrans.h"
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hs] [-M <cols>] [-N <rows>] [-t <threads>] [-r <reps>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h           Print this help message.\n");
+    printf("  -s           Write B with non-temporal stores.\n");
+    printf("  -M <cols>    Columns of A (default 8192).\n");
+    printf("  -N <rows>    Rows of A (default 8192).\n");
+    printf("  -t <n>       Most threads to try (default: number of CPUs).\n");
+    printf("  -r <reps>    Transposes timed per thread count (default 5).\n");
+    printf("Example: %s -M 16384 -N 16384 -s\n", argv[0]);
+}
+
+/*
+ * seconds - monotonic wall-clock time
+ */
+static double seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t M = 8192, N = 8192, i, j;
+    int maxthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int reps = 5, flags = 0, n, r;
+    double base = 0, sec, gbs;
+    ptrans_pool_t *p;
+    int *A, *B;
+    cpu_set_t cpus;
+    char c;
+
+    /* a restricted cpuset or taskset allows fewer CPUs than are online */
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+        maxthreads = CPU_COUNT(&cpus);
+
+    while ((c = getopt(argc, argv, "M:N:t:r:sh")) != -1) {
+        switch (c) {
+        case 'M':
+            M = strtoul(optarg, NULL, 0);
+            break;
+        case 'N':
+            N = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            maxthreads = atoi(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 's':
+            flags |= PTRANS_STREAM;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M == 0 || N == 0 || maxthreads < 1 || reps < 1) {
+        usage(argv);
+        exit(1);
+    }
+
+    printf("%zux%zu ints, %d reps%s\n", N, M, reps,
+           flags & PTRANS_STREAM ? ", streaming stores" : "");
+    printf("%-8s %-10s %s\n", "threads", "GB/s", "speedup");
+    /* doubling, and the CPU count last even if it is not a power of 2 */
+    for (n = 1; ; n = n * 2 < maxthreads ? n * 2 : maxthreads) {
+        if ((p = ptrans_create(n)) == NULL) {
+            fprintf(stderr, "Error: can not start %d threads\n", n);
+            exit(1);
+        }
+        /* A is placed like B, a band of rows per thread */
+        A = ptrans_alloc(p, N, M);
+        B = ptrans_alloc(p, M, N);
+        if (A == NULL || B == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        for (i = 0; i < N; i++)
+            for (j = 0; j < M; j++)
+                A[i * M + j] = (int)(i * 31 + j);
+
+        ptrans_run(p, N, M, A, B, flags);  /* warm up */
+        sec = seconds();
+        for (r = 0; r < reps; r++)
+            ptrans_run(p, N, M, A, B, flags);
+        sec = (seconds() - sec) / reps;
+
+        for (i = 0; i < N; i += 97)
+            for (j = 0; j < M; j += 89)
+                if (B[j * N + i] != A[i * M + j]) {
+                    fprintf(stderr, "Error: wrong result at B[%zu][%zu]\n", j, i);
+                    exit(1);
+                }
+
+        /* bytes of A read plus bytes of B written */
+        gbs = 2.0 * N * M * sizeof(int) / sec / 1e9;
+        if (n == 1)
+            base = gbs;
+        printf("%-8d %-10.2f %.2f\n", n, gbs, gbs / base);
+
+        ptrans_free(A, N, M);
+        ptrans_free(B, M, N);
+        ptrans_destroy(p);
+        if (n == maxthreads)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+ * ptrans.c - Multi-threaded tiled transpose for large matrices
+ *
+ * Thread t owns rows [band(t), band(t+1)) of B, which are columns of A.
+ * It walks them in TILE x TILE blocks, each made of 8x8 tiles that are
+ * transposed in registers with AVX2 when the CPU has it. The bands are
+ * fixed by the pool size, so ptrans_alloc can zero each band on the
+ * thread that will later write it, which places its pages on that
+ * thread's NUMA node under the default first-touch policy.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "ptrans.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Side of the blocks a thread walks its band in, in ints */
+#define TILE 64
+
+/* Jobs the threads of a pool run */
+enum jobkind { JOB_ZERO, JOB_TRANSPOSE };
+
+struct job {
+    enum jobkind kind;
+    size_t N, M;               /* A is N x M, B is M x N */
+    const int *A;
+    int *B;
+    int stream;                /* use non-temporal stores */
+};
+
+struct ptrans_pool {
+    int n;                     /* threads, counting the caller */
+    pthread_t *tid;            /* the n - 1 workers */
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long gen;         /* bumped for every job */
+    int pending;               /* workers still running the job */
+    int quit;
+    struct job job;
+    cpu_set_t saved;           /* the caller's affinity before the pool */
+    int restore;               /* saved is valid */
+    int *cpu;                  /* CPUs in saved, threads are pinned to them */
+    int ncpu;
+};
+
+/* Arguments of a worker thread */
+struct worker {
+    ptrans_pool_t *p;
+    int id;
+};
+
+/*
+ * band - first row of B owned by thread t of n, a multiple of 8 so that
+ *     8x8 tiles never straddle two threads
+ */
+static size_t band(size_t M, int t, int n)
+{
+    return (M * t / n) & ~(size_t)7;
+}
+
+/*
+ * tile8 - transpose the 8x8 tile at a (row length lda) into b (row
+ *     length ldb) one int at a time
+ */
+static void tile8(const int *a, size_t lda, int *b, size_t ldb)
+{
+    int i, j;
+
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 8; j++)
+            b[j * ldb + i] = a[i * lda + j];
+}
+
+#ifdef HAVE_X86
+/*
+ * tile8_avx2 - 8x8 tile in registers, see tile8_avx2 in trans.c. With
+ *     stream set the rows of b must be 32-byte aligned and are written
+ *     with non-temporal stores.
+ */
+__attribute__((target("avx2")))
+static void tile8_avx2(const int *a, size_t lda, int *b, size_t ldb, int stream)
+{
+    __m256i r[8], t[8], o;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r[i] = _mm256_loadu_si256((const __m256i *)(a + i * lda));
+    for (i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (i = 0; i < 8; i += 4) {
+        r[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        r[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (i = 0; i < 8; i++) {
+        o = _mm256_permute2x128_si256(r[i % 4], r[i % 4 + 4],
+                                      i < 4 ? 0x20 : 0x31);
+        if (stream)
+            _mm256_stream_si256((__m256i *)(b + i * ldb), o);
+        else
+            _mm256_storeu_si256((__m256i *)(b + i * ldb), o);
+    }
+}
+
+__attribute__((target("sse2")))
+static void fence(void)
+{
+    _mm_sfence();
+}
+#endif
+
+/*
+ * transpose_band - transpose rows [lo, hi) of B, block by block
+ */
+static void transpose_band(const struct job *jb, size_t lo, size_t hi)
+{
+    size_t N = jb->N, M = jb->M, i0, j0, i, j, iend, jend;
+    const int *A = jb->A;
+    int *B = jb->B;
+    int avx2 = 0;
+
+#ifdef HAVE_X86
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    /* j runs over columns of A, rows of B */
+    for (j0 = lo; j0 < hi; j0 += TILE) {
+        jend = j0 + TILE < hi ? j0 + TILE : hi;
+        for (i0 = 0; i0 < N; i0 += TILE) {
+            iend = i0 + TILE < N ? i0 + TILE : N;
+            for (j = j0; j + 8 <= jend; j += 8) {
+                for (i = i0; i + 8 <= iend; i += 8) {
+#ifdef HAVE_X86
+                    if (avx2) {
+                        tile8_avx2(A + i * M + j, M, B + j * N + i, N,
+                                   jb->stream);
+                        continue;
+                    }
+#endif
+                    tile8(A + i * M + j, M, B + j * N + i, N);
+                }
+                /* columns of B past the last whole tile */
+                for (; i < iend; i++) {
+                    size_t k;
+                    for (k = j; k < j + 8; k++)
+                        B[k * N + i] = A[i * M + k];
+                }
+            }
+            /* rows of B past the last whole tile, only at the end of M */
+            for (; j < jend; j++)
+                for (i = i0; i < iend; i++)
+                    B[j * N + i] = A[i * M + j];
+        }
+    }
+#ifdef HAVE_X86
+    if (avx2 && jb->stream)
+        fence();
+#endif
+}
+
+/*
+ * runjob - do thread t's share of the current job
+ */
+static void runjob(ptrans_pool_t *p, const struct job *jb, int t)
+{
+    size_t lo = band(jb->M, t, p->n);
+    size_t hi = t + 1 == p->n ? jb->M : band(jb->M, t + 1, p->n);
+
+    if (lo >= hi)
+        return;
+    if (jb->kind == JOB_ZERO)
+        memset(jb->B + lo * jb->N, 0, (hi - lo) * jb->N * sizeof(int));
+    else
+        transpose_band(jb, lo, hi);
+}
+
+/*
+ * pin - keep the calling thread, thread t of the pool, on one of the
+ *     CPUs the caller may use, so the pages it first touches stay local
+ *     to it
+ */
+static void pin(ptrans_pool_t *p, int t)
+{
+    cpu_set_t set;
+
+    if (p->ncpu == 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(p->cpu[t % p->ncpu], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ * savecpus - remember the caller's affinity and list the CPUs in it;
+ *     without it threads are not pinned
+ */
+static void savecpus(ptrans_pool_t *p)
+{
+    int c;
+
+    if (sched_getaffinity(0, sizeof(p->saved), &p->saved) != 0)
+        return;
+    p->restore = 1;
+    if ((p->cpu = malloc(CPU_COUNT(&p->saved) * sizeof(int))) == NULL)
+        return;
+    for (c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &p->saved))
+            p->cpu[p->ncpu++] = c;
+    }
+}
+
+/*
+ * worker - wait for jobs and run this thread's share of each
+ */
+static void *worker(void *arg)
+{
+    struct worker w = *(struct worker *)arg;
+    ptrans_pool_t *p = w.p;
+    unsigned long seen = 0;
+    struct job jb;
+
+    free(arg);
+    pin(p, w.id);
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (p->gen == seen && !p->quit)
+            pthread_cond_wait(&p->start, &p->lock);
+        if (p->quit) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        seen = p->gen;
+        jb = p->job;
+        pthread_mutex_unlock(&p->lock);
+
+        runjob(p, &jb, w.id);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->pending == 0)
+            pthread_cond_signal(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/*
+ * runall - run a job on every thread, the caller doing share 0
+ */
+static void runall(ptrans_pool_t *p, const struct job *jb)
+{
+    pthread_mutex_lock(&p->lock);
+    p->job = *jb;
+    p->pending = p->n - 1;
+    p->gen++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    runjob(p, jb, 0);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->pending > 0)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * ptrans_create - start the worker threads
+ */
+ptrans_pool_t *ptrans_create(int nthreads)
+{
+    ptrans_pool_t *p;
+    struct worker *w;
+
+    if (nthreads < 1 || (p = calloc(1, sizeof(ptrans_pool_t))) == NULL)
+        return NULL;
+    if ((p->tid = calloc(nthreads, sizeof(pthread_t))) == NULL) {
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+    savecpus(p);
+    pin(p, 0);
+
+    /* p->n counts the threads running so far, the caller included */
+    for (p->n = 1; p->n < nthreads; p->n++) {
+        if ((w = malloc(sizeof(struct worker))) == NULL)
+            break;
+        w->p = p;
+        w->id = p->n;
+        if (pthread_create(&p->tid[p->n - 1], NULL, worker, w) != 0) {
+            free(w);
+            break;
+        }
+    }
+    if (p->n < nthreads) {
+        ptrans_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
+/*
+ * ptrans_destroy - tell the workers to quit and wait for them, then
+ *     unpin the caller
+ */
+void ptrans_destroy(ptrans_pool_t *p)
+{
+    int i;
+
+    pthread_mutex_lock(&p->lock);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 0; i < p->n - 1; i++)
+        pthread_join(p->tid[i], NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->start);
+    pthread_cond_destroy(&p->done);
+    if (p->restore)
+        sched_setaffinity(0, sizeof(p->saved), &p->saved);
+    free(p->cpu);
+    free(p->tid);
+    free(p);
+}
+
+/*
+ * ptrans_alloc - map untouched pages, then zero each band on its thread
+ */
+int *ptrans_alloc(ptrans_pool_t *p, size_t rows, size_t cols)
+{
+    struct job jb;
+    int *m;
+
+    m = mmap(NULL, rows * cols * sizeof(int), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+        return NULL;
+    memset(&jb, 0, sizeof(jb));
+    jb.kind = JOB_ZERO;
+    jb.M = rows;
+    jb.N = cols;
+    jb.B = m;
+    runall(p, &jb);
+    return m;
+}
+
+/*
+ * ptrans_free - unmap a matrix from ptrans_alloc
+ */
+void ptrans_free(int *m, size_t rows, size_t cols)
+{
+    munmap(m, rows * cols * sizeof(int));
+}
+
+/*
+ * ptrans_run - transpose on the pool. Streaming needs every row of B
+ *     32-byte aligned, otherwise plain stores are used.
+ */
+void ptrans_run(ptrans_pool_t *p, size_t N, size_t M, const int *A, int *B,
+                int flags)
+{
+    struct job jb;
+
+    jb.kind = JOB_TRANSPOSE;
+    jb.N = N;
+    jb.M = M;
+    jb.A = A;
+    jb.B = B;
+    jb.stream = (flags & PTRANS_STREAM) && ((uintptr_t)B & 31) == 0 &&
+                N % 8 == 0;
+    runall(p, &jb);
+}
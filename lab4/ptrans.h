@@ -0,0 +1,51 @@
+/*
+ * ptrans.h - Prototypes for the multi-threaded transpose of large
+ *     matrices
+ *
+ * Unlike the functions in trans.c, which the cache lab drivers limit to
+ * 256x256, these work on matrices of any size in row-major int arrays.
+ * A pool of threads splits the rows of B into bands, one per thread.
+ */
+
+#ifndef CACHELAB_PTRANS_H
+#define CACHELAB_PTRANS_H
+
+#include <stddef.h>
+
+/* Flags for ptrans_run */
+#define PTRANS_STREAM 1    /* non-temporal stores to B, bypassing the cache */
+
+typedef struct ptrans_pool ptrans_pool_t;
+
+/*
+ * ptrans_create - Start a pool of nthreads threads, counting the
+ *     calling thread, each pinned to its own CPU where possible, out of
+ *     those the caller may run on. Returns NULL on failure.
+ */
+ptrans_pool_t *ptrans_create(int nthreads);
+
+/*
+ * ptrans_destroy - Stop the threads and free the pool. Called from the
+ *     thread that created it, which gets its old affinity back.
+ */
+void ptrans_destroy(ptrans_pool_t *p);
+
+/*
+ * ptrans_alloc - Allocate a rows x cols destination matrix, zeroed.
+ *     Each band of rows is first touched by the thread that writes it
+ *     in ptrans_run, so on a NUMA machine its pages land on that
+ *     thread's node. Returns NULL on failure.
+ */
+int *ptrans_alloc(ptrans_pool_t *p, size_t rows, size_t cols);
+
+/* ptrans_free - Free a matrix from ptrans_alloc */
+void ptrans_free(int *m, size_t rows, size_t cols);
+
+/*
+ * ptrans_run - Transpose A, of N rows and M columns, into B, of M rows
+ *     and N columns, on all threads of the pool
+ */
+void ptrans_run(ptrans_pool_t *p, size_t N, size_t M, const int *A, int *B,
+                int flags);
+
+#endif /* CACHELAB_PTRANS_H */
@@ -12,6 +12,9 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "memtrace.h"
+#include "gtrans.h"
+#include "xtrans.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
 
@@ -22,12 +25,15 @@
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
-/* External function defined in trans.c */
+/* External functions defined in trans.c */
 extern void registerFunctions();
+extern void transpose_submit(int M, int N, int A[N][M], int B[M][N]);
 
 /* External variables defined in cachelab-tools.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
+extern inplace_func_t inplace_list[MAX_TRANS_FUNCS];
+extern int inplace_counter;
 
 /* Globals set on the command line */
 static int M = 0;
@@ -41,6 +47,13 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/* Matrices for in-process tracing, laid out like tracegen's: B right
+   after A, so both map to the cache the same way as under valgrind */
+static struct {
+    int A[MAXN][MAXN];
+    int B[MAXN][MAXN];
+} mat;
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
@@ -160,13 +173,238 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
   
 }
 
+/*
+ * eval_native - Evaluate the registered transpose functions in process.
+ *     test-trans links trans-traced.o, whose loads and stores call into
+ *     memtrace, so the cache sees exactly the accesses to A and B that
+ *     valgrind would record, without a separate run or trace file.
+ */
+void eval_native(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, r, c;
+    unsigned int hits, misses, evictions;
+
+    registerFunctions();
+    registerExtraFunctions();
+
+    for (i=0; i<func_counter; i++) {
+        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
+            results.funcid = i; /* remember which function is the submission */
+
+        printf("\nFunction %d (%d total)\nStep 1: Tracing and validating in process\n",i,func_counter);
+        initMatrix(M, N, mat.A, mat.B);
+        if (memtrace_start(s, E, b, &mat, &mat + 1) < 0) {
+            printf("Error: can not allocate the cache model\n");
+            exit(1);
+        }
+        (*func_list[i].func_ptr)(M, N, mat.A, mat.B);
+        memtrace_stop(&hits, &misses, &evictions);
+
+        /* A is read as N rows of M and B as M rows of N, like tracegen */
+        int (*A)[M] = (int (*)[M])mat.A;
+        int (*B)[N] = (int (*)[N])mat.B;
+        for (r = 0; r < N; r++) {
+            for (c = 0; c < M && A[r][c] == B[c][r]; c++)
+                ;
+            if (c < M)
+                break;
+        }
+        if (r < N) {
+            printf("Validation error at function %d! Expected %d but got %d at B[%d][%d]\n"
+                   "Skipping performance evaluation for this function.\n",
+                   i, A[r][c], B[c][r], c, r);
+            continue;
+        }
+
+        func_list[i].correct=1;
+        if (results.funcid == i ) {
+            results.correct = 1;
+        }
+
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+        func_list[i].num_hits = hits;
+        func_list[i].num_misses = misses;
+        func_list[i].num_evictions = evictions;
+        printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
+               i, func_list[i].description, hits, misses, evictions);
+
+        if (results.funcid == i) {
+            results.misses = misses;
+        }
+    }
+}
+
+/*
+ * eval_inplace - Evaluate the registered in-place functions in process.
+ *     B is filled by correctTrans first, and A, transposed in place,
+ *     must match it; only A is touched while tracing.
+ */
+void eval_inplace(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, k;
+    unsigned int hits, misses, evictions;
+    int *A = &mat.A[0][0], *B = &mat.B[0][0];
+
+    registerInplaceFunctions();
+    for (i=0; i<inplace_counter; i++) {
+        printf("\nIn-place function %d (%d total)\nStep 1: Tracing and validating in process\n",
+               i, inplace_counter);
+        initMatrix(M, N, mat.A, mat.B);
+        correctTrans(M, N, mat.A, mat.B);
+        if (memtrace_start(s, E, b, &mat, &mat + 1) < 0) {
+            printf("Error: can not allocate the cache model\n");
+            exit(1);
+        }
+        (*inplace_list[i].func_ptr)(M, N, A);
+        memtrace_stop(&hits, &misses, &evictions);
+
+        /* both are now M rows of N, packed */
+        for (k = 0; k < M * N && A[k] == B[k]; k++)
+            ;
+        if (k < M * N) {
+            printf("Validation error at in-place function %d! Expected %d but got %d at A[%d][%d]\n"
+                   "Skipping performance evaluation for this function.\n",
+                   i, B[k], A[k], k / N, k % N);
+            continue;
+        }
+
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+        printf("in-place func %u (%s): hits:%u, misses:%u, evictions:%u\n",
+               i, inplace_list[i].description, hits, misses, evictions);
+    }
+}
+
+/*
+ * eval_generic - Validate the generic transpose in gtrans.c for every
+ *     element width, on a dense M x N matrix and on a view into a padded
+ *     one, and count its misses in process. The view checks that
+ *     nothing outside it in B is written.
+ */
+void eval_generic(unsigned int s, unsigned int E, unsigned int b)
+{
+    static const size_t sizes[] = {1, 2, 4, 8, 16};
+    unsigned int hits, misses, evictions;
+    size_t w, lda, ldb, arows, brows, i, j, k;
+    int v, bad;
+    char *buf, *A, *B, *a, *bv;
+
+    for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        w = sizes[k];
+        for (v = 0; v < 2; v++) {
+            /* the view: rows 1.. and columns 2.. of A, padded by 3,
+               into rows 1.. and columns 3.. of B, padded by 5 */
+            lda = v ? M + 3 : M;
+            ldb = v ? N + 5 : N;
+            arows = v ? N + 2 : N;
+            brows = v ? M + 1 : M;
+            if ((buf = malloc((arows * lda + brows * ldb) * w)) == NULL) {
+                printf("Error: out of memory\n");
+                exit(1);
+            }
+            A = buf;
+            B = buf + arows * lda * w;
+            for (i = 0; i < arows * lda * w; i++)
+                A[i] = rand();
+            memset(B, 0xee, brows * ldb * w);
+            a = v ? GTRANS_AT(A, lda, w, 1, 2) : A;
+            bv = v ? GTRANS_AT(B, ldb, w, 1, 3) : B;
+
+            if (memtrace_start(s, E, b, buf, B + brows * ldb * w) < 0) {
+                printf("Error: can not allocate the cache model\n");
+                exit(1);
+            }
+            gtrans(w, N, M, a, lda, bv, ldb);
+            memtrace_stop(&hits, &misses, &evictions);
+
+            bad = 0;
+            for (i = 0; i < (size_t)N && !bad; i++)
+                for (j = 0; j < (size_t)M && !bad; j++)
+                    bad = memcmp(GTRANS_AT(bv, ldb, w, j, i),
+                                 GTRANS_AT(a, lda, w, i, j), w) != 0;
+            /* everything in B outside the view is untouched */
+            for (i = 0; i < brows * ldb * w && !bad; i++) {
+                size_t e = i / w, r = e / ldb, c = e % ldb;
+                if (v && (r < 1 || r >= (size_t)M + 1 || c < 3 ||
+                          c >= (size_t)N + 3))
+                    bad = (unsigned char)B[i] != 0xee;
+            }
+
+            printf("generic %2zu-byte %-6s: %s, hits:%u, misses:%u, evictions:%u\n",
+                   w, v ? "view" : "dense", bad ? "WRONG" : "ok",
+                   hits, misses, evictions);
+            free(buf);
+        }
+    }
+}
+
+/*
+ * eval_batch - Transpose a batch of count M x N matrices, packed one
+ *     after another, in process: once one by one with transpose_submit
+ *     and once with trans_batch. Reports the misses of each over the
+ *     whole batch and validates every matrix.
+ */
+void eval_batch(unsigned int s, unsigned int E, unsigned int b, int count)
+{
+    unsigned int hits, misses, evictions;
+    size_t size = (size_t)M * N;
+    int **A, **B, *buf, k, i, run, bad;
+
+    buf = malloc(2 * count * size * sizeof(int));
+    A = malloc(count * sizeof(int *));
+    B = malloc(count * sizeof(int *));
+    if (buf == NULL || A == NULL || B == NULL) {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    for (k = 0; k < count; k++) {
+        A[k] = buf + k * size;
+        B[k] = buf + (count + k) * size;
+    }
+    for (i = 0; i < count * size; i++)
+        buf[i] = rand();
+
+    printf("\nBatch of %d %dx%d matrices (s=%d, E=%d, b=%d)\n",
+           count, M, N, s, E, b);
+    for (run = 0; run < 2; run++) {
+        memset(B[0], 0, count * size * sizeof(int));
+        if (memtrace_start(s, E, b, buf, buf + 2 * count * size) < 0) {
+            printf("Error: can not allocate the cache model\n");
+            exit(1);
+        }
+        if (run == 0) {
+            for (k = 0; k < count; k++)
+                transpose_submit(M, N, (int (*)[M])A[k], (int (*)[N])B[k]);
+        }
+        else
+            trans_batch(M, N, count, A, B);
+        memtrace_stop(&hits, &misses, &evictions);
+
+        bad = 0;
+        for (k = 0; k < count && !bad; k++)
+            for (i = 0; i < size && !bad; i++)
+                bad = B[k][i % M * N + i / M] != A[k][i];
+        printf("%-26s %s, hits:%u, misses:%u, evictions:%u, misses per matrix:%.1f\n",
+               run == 0 ? "transpose_submit each:" : "trans_batch:",
+               bad ? "WRONG" : "ok", hits, misses, evictions,
+               (double)misses / count);
+    }
+    free(A);
+    free(B);
+    free(buf);
+}
+
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hnig] [-w <reps>] [-B <count>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
+    printf("  -n          Trace in process instead of with valgrind.\n");
+    printf("  -i          Also evaluate the in-place functions, in process.\n");
+    printf("  -g          Also validate the generic transpose for every width.\n");
+    printf("  -B <count>  Only evaluate a batch of count matrices, in process.\n");
+    printf("  -w <reps>   Also time each function over reps calls.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
@@ -198,8 +436,9 @@ void sigalrm_handler(int signum){
 int main(int argc, char* argv[])
 {
     char c;
+    int native = 0, inplace = 0, generic = 0, reps = 0, batch = 0;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:nigw:B:h")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +446,21 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'n':
+            native = 1;
+            break;
+        case 'i':
+            inplace = 1;
+            break;
+        case 'g':
+            generic = 1;
+            break;
+        case 'B':
+            batch = atoi(optarg);
+            break;
+        case 'w':
+            reps = atoi(optarg);
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -242,8 +496,40 @@ int main(int argc, char* argv[])
     /* Time out and give up after a while */
     alarm(120);
 
+    /* Batch mode: aggregate misses, and throughput from tracegen-bench */
+    if (batch > 0) {
+        eval_batch(5, 1, 5, batch);
+        if (reps > 0) {
+            char cmd[255];
+            printf("\nWall-clock benchmark (%d batches each)\n", reps);
+            fflush(stdout);
+            sprintf(cmd, "./tracegen-bench -M %d -N %d -T %d -B %d", M, N, reps, batch);
+            system(cmd);
+        }
+        return 0;
+    }
+
     /* Check the performance of the student's transpose function */
-    eval_perf(5, 1, 5);
+    if (native)
+        eval_native(5, 1, 5);
+    else
+        eval_perf(5, 1, 5);
+    if (inplace)
+        eval_inplace(5, 1, 5);
+    if (generic) {
+        printf("\n");
+        eval_generic(5, 1, 5);
+    }
+
+    /* Wall-clock times come from tracegen-bench, which runs trans.c
+       built with -O2 rather than the instrumented or -O0 builds */
+    if (reps > 0) {
+        char cmd[255];
+        printf("\nWall-clock benchmark (%d calls each)\n", reps);
+        fflush(stdout);
+        sprintf(cmd, "./tracegen-bench -M %d -N %d -T %d", M, N, reps);
+        system(cmd);
+    }
   
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
@@ -0,0 +1,263 @@
+/*
+ * tlb.c - TLB and page walk model, see tlb.h
+ *
+ * Each array is set-associative with LRU replacement. An entry holds the
+ * virtual page number shifted left once, with the low bit set for a
+ * 2 MiB page, so the L2 keeps both sizes apart in the same sets. A miss
+ * in L1 looks in L2, and a miss there walks; the page is then filled
+ * into both levels, which are neither inclusive nor exclusive.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "tlb.h"
+
+/* Page sizes */
+#define SMALL_BITS 12
+#define HUGE_BITS 21
+
+/* Virtual addresses have 48 bits, 9 of them per page table level */
+#define VA_BITS 48
+#define LEVEL_BITS 9
+
+/* Tag of an empty entry */
+#define INVALID ULONG_MAX
+
+/* One array: sets rows of ways tags, with their last use */
+struct array {
+    unsigned int sets, ways;
+    unsigned long *tag;
+    unsigned long *stamp;
+};
+
+/* A range of 2 MiB pages */
+struct range {
+    unsigned long lo, hi;
+};
+
+struct tlb {
+    struct array a[3];      /* by enum tlb_array */
+    struct range *huge;
+    unsigned int nhuge, maxhuge;
+    unsigned long clock;
+    unsigned long last;     /* 4 KiB page of the last access plus one */
+    enum tlb_array lastarray;
+    tlb_stats_t st;
+};
+
+/*
+ * initarray - allocate an empty array, or none for 0 entries
+ */
+static int initarray(struct array *a, unsigned int entries, unsigned int ways)
+{
+    unsigned long i;
+
+    memset(a, 0, sizeof(struct array));
+    if (entries == 0)
+        return 0;
+    if (ways == 0 || entries % ways != 0)
+        return -1;
+    a->sets = entries / ways;
+    a->ways = ways;
+    if ((a->sets & (a->sets - 1)) != 0)
+        return -1;
+    a->tag = malloc(entries * sizeof(unsigned long));
+    a->stamp = calloc(entries, sizeof(unsigned long));
+    if (a->tag == NULL || a->stamp == NULL)
+        return -1;
+    for (i = 0; i < entries; i++)
+        a->tag[i] = INVALID;
+    return 0;
+}
+
+/*
+ * lookup - return 1 if the array holds key, making it the most
+ *     recently used of its set; else fill it in place of the LRU entry
+ *     and return 0. The set is indexed by the page number alone, the
+ *     size bit only takes part in the tag.
+ */
+static int lookup(struct array *a, unsigned long key, unsigned long now)
+{
+    unsigned long set = (key >> 1) & (a->sets - 1);
+    unsigned long *tag = a->tag + set * a->ways;
+    unsigned long *stamp = a->stamp + set * a->ways;
+    unsigned int i, lru = 0;
+
+    for (i = 0; i < a->ways; i++) {
+        if (tag[i] == key) {
+            stamp[i] = now;
+            return 1;
+        }
+        if (stamp[i] < stamp[lru])
+            lru = i;
+    }
+    tag[lru] = key;
+    stamp[lru] = now;
+    return 0;
+}
+
+/*
+ * ishuge - return 1 if addr is in a 2 MiB page
+ */
+static int ishuge(const tlb_t *t, unsigned long addr)
+{
+    unsigned int i;
+
+    for (i = 0; i < t->nhuge; i++) {
+        if (addr >= t->huge[i].lo && addr < t->huge[i].hi)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * tlb_parse - up to three pairs of numbers
+ */
+int tlb_parse(const char *spec, tlb_config_t *config)
+{
+    unsigned int n[6];
+    int k, got, len = 0;
+
+    if (strcmp(spec, "default") == 0)
+        return 0;
+    got = sscanf(spec, "%u,%u%n,%u,%u%n,%u,%u%n", &n[0], &n[1], &len,
+                 &n[2], &n[3], &len, &n[4], &n[5], &len);
+    if (got < 2 || got % 2 != 0 || spec[len] != '\0')
+        return -1;
+    for (k = 0; k < got; k += 2) {
+        config->entries[k / 2] = n[k];
+        config->ways[k / 2] = n[k + 1];
+    }
+    return 0;
+}
+
+/*
+ * tlb_default - 64 4-way, 32 4-way, 1536 12-way
+ */
+void tlb_default(tlb_config_t *config)
+{
+    config->entries[TLB_L1] = 64;
+    config->ways[TLB_L1] = 4;
+    config->entries[TLB_L1_HUGE] = 32;
+    config->ways[TLB_L1_HUGE] = 4;
+    config->entries[TLB_L2] = 1536;
+    config->ways[TLB_L2] = 12;
+}
+
+/*
+ * tlb_create - both L1 arrays are needed, the L2 is optional
+ */
+tlb_t *tlb_create(const tlb_config_t *config)
+{
+    tlb_t *t;
+    int i;
+
+    if (config->entries[TLB_L1] == 0 || config->entries[TLB_L1_HUGE] == 0 ||
+        (t = calloc(1, sizeof(tlb_t))) == NULL)
+        return NULL;
+    for (i = TLB_L1; i <= TLB_L2; i++) {
+        if (initarray(&t->a[i], config->entries[i], config->ways[i]) < 0) {
+            tlb_free(t);
+            return NULL;
+        }
+    }
+    return t;
+}
+
+/*
+ * tlb_free - release the arrays and ranges
+ */
+void tlb_free(tlb_t *t)
+{
+    int i;
+
+    if (t == NULL)
+        return;
+    for (i = TLB_L1; i <= TLB_L2; i++) {
+        free(t->a[i].tag);
+        free(t->a[i].stamp);
+    }
+    free(t->huge);
+    free(t);
+}
+
+/*
+ * tlb_hugepages - append the widened range
+ */
+int tlb_hugepages(tlb_t *t, unsigned long lo, unsigned long hi)
+{
+    unsigned long mask = (1UL << HUGE_BITS) - 1;
+
+    if (t->nhuge == t->maxhuge) {
+        struct range *bigger;
+        t->maxhuge = t->maxhuge ? 2 * t->maxhuge : 8;
+        if ((bigger = realloc(t->huge, t->maxhuge * sizeof(struct range))) == NULL)
+            return -1;
+        t->huge = bigger;
+    }
+    t->huge[t->nhuge].lo = lo & ~mask;
+    t->huge[t->nhuge].hi = hi > ULONG_MAX - mask ? ULONG_MAX : (hi + mask) & ~mask;
+    t->nhuge++;
+
+    /* the last page may be in the range now */
+    t->last = 0;
+    return 0;
+}
+
+/*
+ * tlb_access - the last page, L1, L2, then the walk
+ */
+int tlb_access(tlb_t *t, unsigned long addr, unsigned long *walk)
+{
+    unsigned long va = addr & ((1UL << VA_BITS) - 1);
+    int huge, bits, n, level;
+    unsigned long key;
+    enum tlb_array l1;
+
+    /* the same page again is already the most recent entry of its set */
+    if ((addr >> SMALL_BITS) + 1 == t->last) {
+        t->st.hits[t->lastarray]++;
+        return 0;
+    }
+    huge = ishuge(t, addr);
+    bits = huge ? HUGE_BITS : SMALL_BITS;
+    key = (va >> bits) << 1 | huge;
+    l1 = huge ? TLB_L1_HUGE : TLB_L1;
+
+    t->clock++;
+    t->last = (addr >> SMALL_BITS) + 1;
+    t->lastarray = l1;
+    if (lookup(&t->a[l1], key, t->clock)) {
+        t->st.hits[l1]++;
+        return 0;
+    }
+    t->st.misses[l1]++;
+    if (t->a[TLB_L2].sets != 0) {
+        if (lookup(&t->a[TLB_L2], key, t->clock)) {
+            t->st.hits[TLB_L2]++;
+            return 0;
+        }
+        t->st.misses[TLB_L2]++;
+    }
+
+    /* one entry per level from the top, down to the level that maps
+       the page: the entry of a level is indexed by all the bits above */
+    n = (VA_BITS - bits) / LEVEL_BITS;
+    for (level = 0; level < n; level++) {
+        int shift = VA_BITS - LEVEL_BITS * (level + 1);
+        walk[level] = TLB_TABLES + ((unsigned long)level << VA_BITS) +
+                      (va >> shift) * sizeof(unsigned long);
+    }
+    t->st.walks[huge]++;
+    t->st.walkrefs += n;
+    return n;
+}
+
+/*
+ * tlb_stats - copy out the counts
+ */
+void tlb_stats(const tlb_t *t, tlb_stats_t *stats)
+{
+    *stats = t->st;
+}
@@ -0,0 +1,74 @@
+/*
+ * tlb.h - TLB and page walk model, run next to the cache model by csim
+ *
+ * Addresses are translated by a first-level data TLB, split into an
+ * array for 4 KiB pages and one for 2 MiB pages, backed by a second-level
+ * TLB holding both sizes. Pages are 4 KiB except in the ranges given to
+ * tlb_hugepages. A miss in both levels walks the x86-64 page table: four
+ * entry reads for a 4 KiB page, three for a 2 MiB page. The walk returns
+ * the addresses of the entries it reads, so the caller can run them
+ * through a data cache; the tables sit at TLB_TABLES, away from any user
+ * address, one flat array per level.
+ */
+
+#ifndef CACHELAB_TLB_H
+#define CACHELAB_TLB_H
+
+/* Base address of the simulated page tables */
+#define TLB_TABLES (1UL << 56)
+
+/* Most page table entries one walk reads */
+#define TLB_MAXWALK 4
+
+/* The arrays of the TLB */
+enum tlb_array { TLB_L1, TLB_L1_HUGE, TLB_L2 };
+
+/* Entries and ways of each enum tlb_array; the sets, entries / ways, must
+   be a power of two. An L2 of 0 entries means there is none. */
+typedef struct tlb_config {
+    unsigned int entries[3], ways[3];
+} tlb_config_t;
+
+/* Counts of one run */
+typedef struct tlb_stats {
+    unsigned long hits[3], misses[3];   /* by enum tlb_array */
+    unsigned long walks[2];             /* of 4 KiB and of 2 MiB pages */
+    unsigned long walkrefs;             /* page table entries read */
+} tlb_stats_t;
+
+typedef struct tlb tlb_t;
+
+/*
+ * tlb_parse - fill config from "e,w[,he,hw[,e2,w2]]", the entries and
+ *     ways of the L1 4 KiB, L1 2 MiB and L2 arrays; missing ones, or all
+ *     of them for "default", keep what config held. Returns 0, or -1 if
+ *     the spec is wrong.
+ */
+int tlb_parse(const char *spec, tlb_config_t *config);
+
+/* tlb_default - a config like a recent x86-64 core: 64,4,32,4,1536,12 */
+void tlb_default(tlb_config_t *config);
+
+/* tlb_create - empty TLB, or NULL if the config is wrong or out of memory */
+tlb_t *tlb_create(const tlb_config_t *config);
+
+/* tlb_free - release the TLB */
+void tlb_free(tlb_t *t);
+
+/*
+ * tlb_hugepages - map [lo, hi), widened to 2 MiB boundaries, with 2 MiB
+ *     pages. Returns 0, or -1 if out of memory.
+ */
+int tlb_hugepages(tlb_t *t, unsigned long lo, unsigned long hi);
+
+/*
+ * tlb_access - translate addr. Returns the number of page table entries
+ *     the walk read, 0 on a TLB hit, and their addresses in walk, which
+ *     has room for TLB_MAXWALK.
+ */
+int tlb_access(tlb_t *t, unsigned long addr, unsigned long *walk);
+
+/* tlb_stats - the counts so far */
+void tlb_stats(const tlb_t *t, tlb_stats_t *stats);
+
+#endif /* CACHELAB_TLB_H */
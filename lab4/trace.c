@@ -0,0 +1,421 @@
+/*
+ * trace.c - Memory trace reader and writer for the cache lab tools
+ *
+ * Regular files are mapped with mmap and parsed in place, without
+ * copying. Anything else, such as a pipe or "-" for standard input, is
+ * streamed through a fixed buffer, so valgrind output can be piped
+ * straight into csim. Lines that are not memory references, like
+ * valgrind's own "==pid==" messages, are skipped. Traces starting with
+ * TRACE_MAGIC are decoded as the binary format described in trace.h.
+ * Thread switches are consumed by the reader, which tags every
+ * reference with the current thread.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+/* Size of the buffer used when streaming */
+#define STREAM_BUF (1 << 20)
+
+/* A reference line or record is never longer than this */
+#define MAXREF 128
+
+/* Binary op codes, index is the top 2 bits of the op byte */
+static const char opname[4] = { 'L', 'S', 'M', 'I' };
+
+struct trace {
+    int fd;
+    int mapped;            /* buf is the mmapped file */
+    int binary;            /* records are in the binary format */
+    unsigned long prev;    /* binary: address of the previous record */
+    int thread;            /* thread of the references being read */
+    int eof;               /* streaming: nothing left to read */
+    int partial;           /* streaming: skipping the rest of a long line */
+    char *buf;
+    size_t len;            /* bytes in buf */
+    const char *cur;       /* next byte to parse */
+    const char *end;       /* end of the valid bytes in buf */
+};
+
+/* Value of each hex digit, 0xff for all other characters */
+static unsigned char hexval[256];
+
+/*
+ * inithex - fill in the hex digit table on first use
+ */
+static void inithex(void)
+{
+    int i;
+
+    if (hexval['1'] == 1)
+        return;
+    memset(hexval, 0xff, sizeof(hexval));
+    for (i = 0; i < 10; i++)
+        hexval['0' + i] = i;
+    for (i = 0; i < 6; i++) {
+        hexval['a' + i] = 10 + i;
+        hexval['A' + i] = 10 + i;
+    }
+}
+
+/*
+ * refill - move the unparsed tail to the front of the stream buffer
+ *     and read until it is full or the input ends
+ */
+static void refill(trace_t *t)
+{
+    size_t left = t->end - t->cur;
+    ssize_t n;
+
+    memmove(t->buf, t->cur, left);
+    t->len = left;
+    while (t->len < STREAM_BUF) {
+        n = read(t->fd, t->buf + t->len, STREAM_BUF - t->len);
+        if (n <= 0) {
+            t->eof = 1;
+            break;
+        }
+        t->len += n;
+    }
+    t->cur = t->buf;
+    t->end = t->buf + t->len;
+}
+
+/*
+ * skipline - move past the next newline; when streaming and the line
+ *     runs past the buffer, remember to skip the rest after a refill
+ */
+static void skipline(trace_t *t)
+{
+    const char *nl = memchr(t->cur, '\n', t->end - t->cur);
+
+    if (nl != NULL) {
+        t->cur = nl + 1;
+        t->partial = 0;
+    } else {
+        t->cur = t->end;
+        t->partial = !t->mapped && !t->eof;
+    }
+}
+
+/*
+ * parseline - parse a line like " L 7ff000398,8" or "I  0400d7d4,3".
+ *     Returns 1 and fills in ref for a reference, 0 for any other line,
+ *     a thread switch "T 2" included. Either way the line is consumed.
+ */
+static int parseline(trace_t *t, trace_ref_t *ref)
+{
+    const unsigned char *p = (const unsigned char *)t->cur;
+    const unsigned char *end = (const unsigned char *)t->end;
+    unsigned long addr = 0;
+    int size = 0;
+    unsigned char op, d;
+
+    while (p < end && *p == ' ')
+        p++;
+    if (p >= end)
+        goto skip;
+    op = *p++;
+    if (op == 'T') {
+        int thread = 0;
+        while (p < end && *p == ' ')
+            p++;
+        if (p >= end || *p < '0' || *p > '9')
+            goto skip;
+        while (p < end && *p >= '0' && *p <= '9')
+            thread = thread * 10 + (*p++ - '0');
+        t->thread = thread;
+        goto skip;
+    }
+    if (op != 'L' && op != 'S' && op != 'M' && op != 'I')
+        goto skip;
+    if (p >= end || *p != ' ')
+        goto skip;
+    while (p < end && *p == ' ')
+        p++;
+
+    /* hex address, at least one digit */
+    if (p >= end || hexval[*p] == 0xff)
+        goto skip;
+    while (p < end && (d = hexval[*p]) != 0xff) {
+        addr = (addr << 4) | d;
+        p++;
+    }
+    if (p >= end || *p != ',')
+        goto skip;
+    p++;
+
+    /* decimal size */
+    while (p < end && *p >= '0' && *p <= '9') {
+        size = size * 10 + (*p - '0');
+        p++;
+    }
+
+    ref->op = op;
+    ref->addr = addr;
+    ref->size = size;
+    ref->thread = t->thread;
+    t->cur = (const char *)p;
+    skipline(t);
+    return 1;
+
+skip:
+    skipline(t);
+    return 0;
+}
+
+/*
+ * getvarint - decode an unsigned LEB128 varint at *pp, advancing *pp.
+ *     Returns -1 if the input ends inside the varint.
+ */
+static int getvarint(const unsigned char **pp, const unsigned char *end,
+                     unsigned long *val)
+{
+    const unsigned char *p = *pp;
+    unsigned long v = 0;
+    int shift = 0;
+
+    do {
+        if (p >= end || shift > 63)
+            return -1;
+        v |= (unsigned long)(*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+    *val = v;
+    return 0;
+}
+
+/*
+ * parserecord - decode one binary record. Returns 1 and fills in ref,
+ *     or 0 for a thread switch or when the trace ends inside a record.
+ */
+static int parserecord(trace_t *t, trace_ref_t *ref)
+{
+    const unsigned char *p = (const unsigned char *)t->cur;
+    const unsigned char *end = (const unsigned char *)t->end;
+    unsigned long size, delta;
+    unsigned char op = *p++;
+
+    size = op & 0x3f;
+    if ((size == 0 && getvarint(&p, end, &size) < 0) ||
+        getvarint(&p, end, &delta) < 0) {
+        t->cur = t->end;
+        return 0;
+    }
+    if (opname[op >> 6] == 'I' && size == 0) {
+        t->thread = (int)delta;
+        t->cur = (const char *)p;
+        return 0;
+    }
+
+    /* undo the zigzag mapping of the signed delta */
+    t->prev += (delta >> 1) ^ -(delta & 1);
+    ref->op = opname[op >> 6];
+    ref->size = (int)size;
+    ref->addr = t->prev;
+    ref->thread = t->thread;
+    t->cur = (const char *)p;
+    return 1;
+}
+
+/*
+ * checkmagic - switch to the binary format if the trace starts with
+ *     TRACE_MAGIC
+ */
+static void checkmagic(trace_t *t)
+{
+    size_t n = strlen(TRACE_MAGIC);
+
+    if ((size_t)(t->end - t->cur) >= n && memcmp(t->cur, TRACE_MAGIC, n) == 0) {
+        t->binary = 1;
+        t->cur += n;
+    }
+}
+
+/*
+ * trace_open - map the trace if it is a regular file, else stream it
+ */
+trace_t *trace_open(const char *path)
+{
+    trace_t *t;
+    struct stat st;
+
+    inithex();
+    if ((t = calloc(1, sizeof(trace_t))) == NULL)
+        return NULL;
+
+    if (strcmp(path, "-") == 0)
+        t->fd = STDIN_FILENO;
+    else if ((t->fd = open(path, O_RDONLY)) < 0) {
+        free(t);
+        return NULL;
+    }
+
+    if (fstat(t->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        t->buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, t->fd, 0);
+        if (t->buf != MAP_FAILED) {
+            madvise(t->buf, st.st_size, MADV_SEQUENTIAL);
+            t->mapped = 1;
+            t->eof = 1;
+            t->len = st.st_size;
+            t->cur = t->buf;
+            t->end = t->buf + t->len;
+            checkmagic(t);
+            return t;
+        }
+    }
+
+    /* not mappable, fall back to streaming */
+    if ((t->buf = malloc(STREAM_BUF)) == NULL) {
+        trace_close(t);
+        return NULL;
+    }
+    t->cur = t->end = t->buf;
+    refill(t);
+    checkmagic(t);
+    return t;
+}
+
+/*
+ * trace_next - parse lines or records until the next reference or the
+ *     end; a truncated record moves cur to the end
+ */
+int trace_next(trace_t *t, trace_ref_t *ref)
+{
+    for (;;) {
+        /* keep at least one whole line buffered while streaming */
+        if (!t->eof && t->end - t->cur < MAXREF) {
+            refill(t);
+            if (t->partial)
+                skipline(t);
+            continue;
+        }
+        if (t->cur >= t->end)
+            return 0;
+        if (t->binary ? parserecord(t, ref) : parseline(t, ref))
+            return 1;
+    }
+}
+
+/*
+ * trace_close - unmap or free the buffer and close the file
+ */
+void trace_close(trace_t *t)
+{
+    if (t->buf != NULL) {
+        if (t->mapped)
+            munmap(t->buf, t->len);
+        else
+            free(t->buf);
+    }
+    if (t->fd != STDIN_FILENO)
+        close(t->fd);
+    free(t);
+}
+
+struct trace_out {
+    FILE *fp;
+    unsigned long prev;    /* address of the previous record */
+    int thread;            /* thread of the previous record */
+};
+
+/*
+ * putvarint - encode v as an unsigned LEB128 varint at p, return the
+ *     number of bytes used
+ */
+static int putvarint(unsigned char *p, unsigned long v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/*
+ * trace_create - open the output and write the magic bytes
+ */
+trace_out_t *trace_create(const char *path)
+{
+    trace_out_t *w;
+
+    if ((w = calloc(1, sizeof(trace_out_t))) == NULL)
+        return NULL;
+    if (strcmp(path, "-") == 0)
+        w->fp = stdout;
+    else if ((w->fp = fopen(path, "wb")) == NULL) {
+        free(w);
+        return NULL;
+    }
+    fputs(TRACE_MAGIC, w->fp);
+    return w;
+}
+
+/*
+ * trace_write - encode one reference as a binary record, after a thread
+ *     switch if its thread is not the one of the record before
+ */
+int trace_write(trace_out_t *w, const trace_ref_t *ref)
+{
+    unsigned char rec[3 + 10 + 1 + 10 + 10];
+    long delta = (long)(ref->addr - w->prev);
+    int code, op, n = 0;
+
+    switch (ref->op) {
+    case 'L': code = 0; break;
+    case 'S': code = 1; break;
+    case 'M': code = 2; break;
+    case 'I': code = 3; break;
+    default: return -1;
+    }
+
+    /* an I record of size 0 can not be told from a thread switch */
+    if (code == 3 && ref->size == 0)
+        return -1;
+    if (ref->thread != w->thread) {
+        rec[n++] = 3 << 6;
+        rec[n++] = 0;
+        n += putvarint(rec + n, (unsigned long)ref->thread);
+        w->thread = ref->thread;
+    }
+    op = n++;
+
+    /* small sizes share the op byte, others follow as a varint */
+    if (ref->size > 0 && ref->size < 0x40)
+        rec[op] = (unsigned char)(code << 6 | ref->size);
+    else {
+        rec[op] = (unsigned char)(code << 6);
+        n += putvarint(rec + n, (unsigned long)ref->size);
+    }
+
+    /* zigzag so that small negative deltas stay small */
+    n += putvarint(rec + n, ((unsigned long)delta << 1) ^ (unsigned long)(delta >> 63));
+    w->prev = ref->addr;
+    return fwrite(rec, 1, n, w->fp) == (size_t)n ? 0 : -1;
+}
+
+/*
+ * trace_finish - flush the records and close the output
+ */
+int trace_finish(trace_out_t *w)
+{
+    int rc = ferror(w->fp) ? -1 : 0;
+
+    if (w->fp == stdout) {
+        if (fflush(w->fp) != 0)
+            rc = -1;
+    } else if (fclose(w->fp) != 0)
+        rc = -1;
+    free(w);
+    return rc;
+}
@@ -0,0 +1,66 @@
+/*
+ * trace.h - Prototypes for the memory trace reader and writer shared
+ *     by the cache lab tools
+ *
+ * Traces are either valgrind lackey text or a compact binary format.
+ * A binary trace starts with the 4 bytes of TRACE_MAGIC, followed by
+ * one record per reference:
+ *     op byte    operation in the top 2 bits (L, S, M, I = 0..3) and
+ *                the size in the low 6 bits, or 0 if it does not fit
+ *     size       unsigned LEB128 varint, only present if the op byte
+ *                holds no size
+ *     delta      zigzag LEB128 varint, the address minus the address
+ *                of the previous record (0 before the first one)
+ *
+ * References of multi-threaded programs carry the thread that made
+ * them. A text line "T <id>", or in the binary format an I record of
+ * size 0 whose delta is the id instead, switches to thread id for the
+ * references after it; before any switch the thread is 0.
+ */
+
+#ifndef CACHELAB_TRACE_H
+#define CACHELAB_TRACE_H
+
+/* One memory reference from a trace */
+typedef struct trace_ref {
+    char op;               /* 'I', 'L', 'S' or 'M' */
+    int size;              /* number of bytes accessed */
+    unsigned long addr;    /* address of the first byte */
+    int thread;            /* thread that made the reference */
+} trace_ref_t;
+
+typedef struct trace trace_t;
+typedef struct trace_out trace_out_t;
+
+/* Leading bytes of a binary trace */
+#define TRACE_MAGIC "\177CT1"
+
+/*
+ * trace_open - Open a text or binary trace for reading, the format is
+ *     detected from the first bytes. A path of "-" reads standard
+ *     input. Returns NULL if it can not be opened.
+ */
+trace_t *trace_open(const char *path);
+
+/*
+ * trace_next - Store the next reference in ref. Returns 1 on success
+ *     and 0 at the end of the trace.
+ */
+int trace_next(trace_t *t, trace_ref_t *ref);
+
+/* trace_close - Release the trace and everything it holds */
+void trace_close(trace_t *t);
+
+/*
+ * trace_create - Create a binary trace for writing. A path of "-"
+ *     writes standard output. Returns NULL if it can not be created.
+ */
+trace_out_t *trace_create(const char *path);
+
+/* trace_write - Append one reference. Returns 0 on success, -1 on error */
+int trace_write(trace_out_t *w, const trace_ref_t *ref);
+
+/* trace_finish - Flush and close. Returns 0 on success, -1 on error */
+int trace_finish(trace_out_t *w);
+
+#endif /* CACHELAB_TRACE_H */
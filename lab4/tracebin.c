@@ -0,0 +1,110 @@
+/*
+ * tracebin.c - Convert a valgrind lackey trace to the compact binary
+ *     trace format read by csim, or a binary trace back to text.
+ *
+ * Either side may be "-" for standard input or output, so valgrind
+ * can be piped straight in:
+ *     valgrind --tool=lackey --trace-mem=yes --log-fd=1 ./prog |
+ *         ./tracebin -i - -o prog.ctb
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace.h"
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hl] -i <infile> -o <outfile>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -l          Write lackey text instead of binary.\n");
+    printf("  -i <file>   Trace to read, text or binary (- for stdin).\n");
+    printf("  -o <file>   Trace to write (- for stdout).\n");
+    printf("Example: %s -i traces/long.trace -o long.ctb\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char *in = NULL, *out = NULL;
+    int text = 0;
+    unsigned long count = 0;
+    trace_ref_t ref;
+    trace_t *trace;
+    char c;
+
+    while ((c = getopt(argc, argv, "i:o:lh")) != -1) {
+        switch (c) {
+        case 'i':
+            in = optarg;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'l':
+            text = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (in == NULL || out == NULL) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if ((trace = trace_open(in)) == NULL) {
+        fprintf(stderr, "Error: can not open %s\n", in);
+        exit(1);
+    }
+
+    if (text) {
+        /* same layout valgrind uses, instructions start in column 0 */
+        int thread = 0;
+        FILE *fp = (out[0] == '-' && out[1] == '\0') ? stdout : fopen(out, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "Error: can not create %s\n", out);
+            exit(1);
+        }
+        while (trace_next(trace, &ref)) {
+            if (ref.thread != thread) {
+                fprintf(fp, "T %d\n", ref.thread);
+                thread = ref.thread;
+            }
+            if (ref.op == 'I')
+                fprintf(fp, "I  %08lx,%d\n", ref.addr, ref.size);
+            else
+                fprintf(fp, " %c %08lx,%d\n", ref.op, ref.addr, ref.size);
+            count++;
+        }
+        if (fp != stdout)
+            fclose(fp);
+    } else {
+        trace_out_t *w = trace_create(out);
+        if (w == NULL) {
+            fprintf(stderr, "Error: can not create %s\n", out);
+            exit(1);
+        }
+        while (trace_next(trace, &ref)) {
+            if (trace_write(w, &ref) < 0)
+                break;
+            count++;
+        }
+        if (trace_finish(w) < 0) {
+            fprintf(stderr, "Error: writing %s failed\n", out);
+            exit(1);
+        }
+    }
+    trace_close(trace);
+
+    fprintf(stderr, "%lu references\n", count);
+    return 0;
+}
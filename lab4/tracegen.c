@@ -5,22 +5,31 @@
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
  * addresses are recorded in file for later use.
+ *
+ * With -T reps it times the functions instead, those of xtrans.c too,
+ * for test-trans -w, and with -B count as well it times a batch of
+ * matrices, for test-trans -B.
  */
-
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "xtrans.h"
 #include <string.h>
+#include <time.h>
 
 /* External variables declared in cachelab.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
+extern inplace_func_t inplace_list[MAX_TRANS_FUNCS];
+extern int inplace_counter;
 
-/* External function from trans.c */
+/* External functions from trans.c */
 extern void registerFunctions();
+extern void transpose_submit(int M, int N, int A[N][M], int B[M][N]);
 
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
@@ -46,12 +55,102 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * bench - time reps calls of function fn and print the time per call
+ *     and the bandwidth, counting the bytes of A read and B written
+ */
+void bench(int fn, int reps) {
+    struct timespec start, end;
+    double sec;
+    int r;
+
+    (*func_list[fn].func_ptr)(M, N, A, B);  /* warm up */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < reps; r++)
+        (*func_list[fn].func_ptr)(M, N, A, B);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("func %d (%s): %.3f us per call, %.2f GB/s\n", fn,
+           func_list[fn].description, sec / reps * 1e6,
+           2.0 * M * N * sizeof(int) * reps / sec / 1e9);
+}
+
+/*
+ * bench_inplace - time in-place function fn like bench. Calls alternate
+ *     between N x M and M x N, so A is back where it started every two.
+ */
+void bench_inplace(int fn, int reps) {
+    struct timespec start, end;
+    double sec;
+    int r;
+
+    (*inplace_list[fn].func_ptr)(M, N, &A[0][0]);  /* warm up */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < reps; r++) {
+        if (r % 2 == 0)
+            (*inplace_list[fn].func_ptr)(N, M, &A[0][0]);
+        else
+            (*inplace_list[fn].func_ptr)(M, N, &A[0][0]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("in-place func %d (%s): %.3f us per call, %.2f GB/s\n", fn,
+           inplace_list[fn].description, sec / reps * 1e6,
+           2.0 * M * N * sizeof(int) * reps / sec / 1e9);
+}
+
+/*
+ * bench_batch - time reps batches of count matrices, one by one with
+ *     transpose_submit and with trans_batch, and print the throughput
+ */
+void bench_batch(int count, int reps) {
+    struct timespec start, end;
+    size_t size = (size_t)M * N;
+    int **a, **b, *buf, k, r, run;
+    double sec;
+
+    buf = calloc(2 * count * size, sizeof(int));
+    a = malloc(count * sizeof(int *));
+    b = malloc(count * sizeof(int *));
+    if (buf == NULL || a == NULL || b == NULL) {
+        printf("./tracegen: out of memory\n");
+        exit(1);
+    }
+    for (k = 0; k < count; k++) {
+        a[k] = buf + k * size;
+        b[k] = buf + (count + k) * size;
+    }
+
+    for (run = 0; run < 2; run++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++) {
+            if (run == 0) {
+                for (k = 0; k < count; k++)
+                    transpose_submit(M, N, (int (*)[M])a[k], (int (*)[N])b[k]);
+            }
+            else
+                trans_batch(M, N, count, a, b);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%-22s %.3f us per batch, %.0f matrices/s, %.2f GB/s\n",
+               run == 0 ? "transpose_submit each:" : "trans_batch:",
+               sec / reps * 1e6, (double)count * reps / sec,
+               2.0 * count * size * sizeof(int) * reps / sec / 1e9);
+    }
+    free(a);
+    free(b);
+    free(buf);
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int reps=0;
+    int batch=0;
+    while( (c=getopt(argc,argv,"M:N:F:T:B:")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +161,12 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'T':
+            reps = atoi(optarg);
+            break;
+        case 'B':
+            batch = atoi(optarg);
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -76,6 +181,23 @@ int main(int argc, char* argv[]){
     /* Fill A with data */
     initMatrix(M,N, A, B); 
 
+    /* Benchmark mode: only time the functions, or a batch */
+    if (reps > 0 && batch > 0) {
+        bench_batch(batch, reps);
+        return 0;
+    }
+    if (reps > 0) {
+        registerExtraFunctions();
+        registerInplaceFunctions();
+        for (i=0; i < func_counter; i++) {
+            if (-1==selectedFunc || i==selectedFunc)
+                bench(i, reps);
+        }
+        for (i=0; i < inplace_counter && -1==selectedFunc; i++)
+            bench_inplace(i, reps);
+        return 0;
+    }
+
     /* Record marker addresses */
     FILE* marker_fp = fopen(".marker","w");
     assert(marker_fp);
@@ -0,0 +1,146 @@
+/*
+ * tune.c - Parameterized transpose kernel for autotune
+ *
+ * One function covers the variants the hand-tuned transpose_submit
+ * picks between: the tile shape, the order the tiles are visited in and
+ * how each tile is copied. The Makefile builds it twice, once with -O2
+ * for timing and once as tune_trans_traced with memtrace hooks for the
+ * simulated misses.
+ */
+#include "tune.h"
+
+/*
+ * tile_plain - copy the tile element by element
+ */
+static void tile_plain(int M, int N, int A[N][M], int B[M][N],
+                       int i0, int i1, int j0, int j1)
+{
+    int i, j;
+
+    for (i = i0; i < i1; i++) {
+        for (j = j0; j < j1; j++) {
+            B[j][i] = A[i][j];
+        }
+    }
+}
+
+/*
+ * tile_defer - copy the tile, keeping the diagonal element of each row
+ *     for last so that A's row is not evicted by the write to B's row
+ *     in the same set
+ */
+static void tile_defer(int M, int N, int A[N][M], int B[M][N],
+                       int i0, int i1, int j0, int j1)
+{
+    int i, j, d = 0;
+
+    for (i = i0; i < i1; i++) {
+        for (j = j0; j < j1; j++) {
+            if (i == j)
+                d = A[i][j];
+            else
+                B[j][i] = A[i][j];
+        }
+        if (i >= j0 && i < j1)
+            B[i][i] = d;
+    }
+}
+
+/*
+ * tile_rowbuf - read each row of the tile into locals before writing
+ *     any of it, so A's line is used up before B can evict it
+ */
+static void tile_rowbuf(int M, int N, int A[N][M], int B[M][N],
+                        int i0, int i1, int j0, int j1)
+{
+    int i, j, buf[TUNE_MAXTILE];
+
+    for (i = i0; i < i1; i++) {
+        for (j = j0; j < j1; j++)
+            buf[j - j0] = A[i][j];
+        for (j = j0; j < j1; j++)
+            B[j][i] = buf[j - j0];
+    }
+}
+
+/*
+ * tile_split - the 64x64 scheme of transpose_submit for a 2h x 2h tile.
+ *     Rows of A's top half go to B's top half, the right quarter parked
+ *     in B's top right. Then, column by column, the parked values move
+ *     to B's bottom left as A's bottom left fills their place, and the
+ *     bottom right is copied last. B's top rows are only ever loaded
+ *     once, which is what saves misses when rows h apart share a set.
+ */
+static void tile_split(int M, int N, int A[N][M], int B[M][N],
+                       int i0, int j0, int h)
+{
+    int r, c, buf[TUNE_MAXTILE], col[TUNE_MAXTILE / 2];
+
+    for (r = 0; r < h; r++) {
+        for (c = 0; c < 2 * h; c++)
+            buf[c] = A[i0 + r][j0 + c];
+        for (c = 0; c < h; c++) {
+            B[j0 + c][i0 + r] = buf[c];
+            B[j0 + c][i0 + h + r] = buf[h + c];
+        }
+    }
+    for (c = 0; c < h; c++) {
+        for (r = 0; r < h; r++) {
+            buf[r] = B[j0 + c][i0 + h + r];
+            col[r] = A[i0 + h + r][j0 + c];
+        }
+        for (r = 0; r < h; r++)
+            B[j0 + c][i0 + h + r] = col[r];
+        for (r = 0; r < h; r++)
+            B[j0 + h + c][i0 + r] = buf[r];
+    }
+    for (r = h; r < 2 * h; r++) {
+        for (c = h; c < 2 * h; c++)
+            buf[c] = A[i0 + r][j0 + c];
+        for (c = h; c < 2 * h; c++)
+            B[j0 + c][i0 + r] = buf[c];
+    }
+}
+
+/*
+ * tune_trans - visit the tiles in the given order and copy each with
+ *     the given kernel. Split needs whole square tiles of even
+ *     side, others fall back to rowbuf.
+ */
+void tune_trans(int M, int N, int A[N][M], int B[M][N], const tune_t *t)
+{
+    int n, i0, j0, i1, j1;
+    int nr = (N + t->rows - 1) / t->rows, nc = (M + t->cols - 1) / t->cols;
+
+    for (n = 0; n < nr * nc; n++) {
+        if (t->order == TUNE_ROWS) {
+            i0 = n / nc * t->rows;
+            j0 = n % nc * t->cols;
+        }
+        else {
+            i0 = n % nr * t->rows;
+            j0 = n / nr * t->cols;
+        }
+        i1 = i0 + t->rows < N ? i0 + t->rows : N;
+        j1 = j0 + t->cols < M ? j0 + t->cols : M;
+
+        switch (t->kernel) {
+        case TUNE_DEFER:
+            tile_defer(M, N, A, B, i0, i1, j0, j1);
+            break;
+        case TUNE_SPLIT:
+            if (t->rows == t->cols && t->rows % 2 == 0 &&
+                i1 - i0 == t->rows && j1 - j0 == t->cols) {
+                tile_split(M, N, A, B, i0, j0, t->rows / 2);
+                break;
+            }
+            /* fall through */
+        case TUNE_ROWBUF:
+            tile_rowbuf(M, N, A, B, i0, i1, j0, j1);
+            break;
+        default:
+            tile_plain(M, N, A, B, i0, i1, j0, j1);
+            break;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/*
+ * tune.h - Parameterized transpose kernel searched by autotune
+ */
+
+#ifndef CACHELAB_TUNE_H
+#define CACHELAB_TUNE_H
+
+/* Largest tile side the kernels buffer */
+#define TUNE_MAXTILE 32
+
+/* Order the tiles are visited in */
+#define TUNE_ROWS 0     /* along the rows of A, then down */
+#define TUNE_COLS 1     /* down the columns of A, then across */
+
+/* How a tile is copied */
+#define TUNE_PLAIN 0    /* element by element */
+#define TUNE_DEFER 1    /* diagonal element of each row written last */
+#define TUNE_ROWBUF 2   /* a row of the tile read into locals, then written */
+#define TUNE_SPLIT 3    /* square tiles in quarters, parked in B (see tune.c) */
+
+typedef struct tune {
+    int rows, cols;     /* tile of A, at most TUNE_MAXTILE each */
+    int order;          /* TUNE_ROWS or TUNE_COLS */
+    int kernel;         /* TUNE_PLAIN ... TUNE_SPLIT */
+} tune_t;
+
+/* tune_trans - B = A^T with the tiling described by t */
+void tune_trans(int M, int N, int A[N][M], int B[M][N], const tune_t *t);
+
+/* The same kernel built with memtrace hooks, see the Makefile */
+void tune_trans_traced(int M, int N, int A[N][M], int B[M][N],
+                       const tune_t *t);
+
+#endif /* CACHELAB_TUNE_H */
@@ -0,0 +1,29 @@
+/*
+ * xtrans.h - Prototypes for the experimental transposes in xtrans.c
+ */
+
+#ifndef CACHELAB_XTRANS_H
+#define CACHELAB_XTRANS_H
+
+/* Out-of-place transposes, with the signature of those in trans.c */
+void trans_recursive(int M, int N, int A[N][M], int B[M][N]);
+void trans_simd(int M, int N, int A[N][M], int B[M][N]);
+void trans_tiles_scalar(int M, int N, int A[N][M], int B[M][N]);
+
+/*
+ * trans_batch - Transpose count M x N matrices, B[k] = A[k]^T, with the
+ *     SIMD 8x8 kernels
+ */
+void trans_batch(int M, int N, int count, int *const A[], int *const B[]);
+
+/* In-place transposes: A holds N rows of M, then M rows of N */
+void trans_inplace(int M, int N, int *A);
+void trans_inplace_cycles(int M, int N, int *A);
+
+/* registerExtraFunctions - register the out-of-place transposes */
+void registerExtraFunctions();
+
+/* registerInplaceFunctions - register the in-place transposes */
+void registerInplaceFunctions();
+
+#endif /* CACHELAB_XTRANS_H */
@@ -24,6 +24,10 @@
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#ifdef CACHESIM
+#include "cache.h"
+#include "memtrace.h"
+#endif
 
 /**********************
  * Constants and macros
@@ -109,6 +113,17 @@ typedef struct {
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+#ifdef CACHESIM
+/* Misses of one trace at one cache level, by request type (ALLOC, FREE,
+   REALLOC). mm counts the misses of the allocator's own accesses during
+   the call, payload those of the block touches the driver adds. */
+typedef struct {
+    unsigned long ops[3];
+    unsigned long mm[3];
+    unsigned long payload[3];
+} cache_result_t;
+#endif
+
 /* Summarizes the key statistics for a set of traces */
 typedef struct {
     double util;  /* average utilization expressed as a percentage */
@@ -122,7 +137,8 @@ typedef struct {
  * at a "random" place (a hash of the index), and copy random data
  * into it.  With DBG_CHEAP, we check that the data survived when we
  * realloc and when we free.  With DBG_EXPENSIVE, we check every block
- * every operation.
+ * every operation.  DBG_INCREMENTAL does the DBG_CHEAP checks and lets
+ * the student check one slice of their heap every operation.
  * randint_t should be a byte, in case students return unaligned memory.
  *******************/
 #define RANDOM_DATA_LEN (1<<16)
@@ -135,7 +151,8 @@ static randint_t random_data[RANDOM_DATA_LEN];
  * Global variables
  *******************/
 
-static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
+static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE, DBG_INCREMENTAL }
+    debug_mode = DBG_CHEAP;
 
 int verbose = 1;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
@@ -154,6 +171,15 @@ static char *default_tracefiles[] = {
 
 char autoresult[MAXLINE]; /* autoresult string */
 
+#ifdef CACHESIM
+/* Cache hierarchy simulated for each trace (-L), L1 first */
+static cache_config_t cachecfg[CACHE_MAXLEVEL];
+static int ncachelevels = 0;
+
+/* Results, CACHE_MAXLEVEL per trace */
+static cache_result_t *cache_results;
+#endif
+
 /* Summary statistics for libc and student's mm.c submissions */
 sum_stats_t global_libc_sum_stats;
 sum_stats_t global_mm_sum_stats;
@@ -188,6 +214,13 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+#ifdef CACHESIM
+static void eval_mm_cache(trace_t *trace, int tracenum,
+                          cache_result_t *results);
+static void printcacherow(const char *valid, const cache_result_t *r,
+                          const char *name);
+static void printcache(int n, stats_t *stats);
+#endif
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
@@ -242,6 +275,16 @@ static void run_tests(int num_tracefiles, const char *tracedir,
                 return;
             }
         }
+#ifdef CACHESIM
+        if (mm_stats[i].valid) {
+            if (verbose > 1)
+                printf("and cache misses.\n");
+            eval_mm_cache(trace, i, &cache_results[i * CACHE_MAXLEVEL]);
+            free_trace(trace);
+            mem_deinit();
+            continue;
+        }
+#endif
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
@@ -290,7 +333,11 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+#ifdef CACHESIM
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDIL:")) != EOF) {
+#else
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDI")) != EOF) {
+#endif
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -344,10 +391,25 @@ int main(int argc, char **argv)
             debug_mode = DBG_EXPENSIVE;
             break;
 
+        case 'I':
+            debug_mode = DBG_INCREMENTAL;
+            break;
+
         case 's':
             set_timeout = atoi(optarg);
             break;
 
+#ifdef CACHESIM
+        case 'L': /* Add a cache level, as in csim -L */
+            if (ncachelevels == CACHE_MAXLEVEL ||
+                cache_parse_level(optarg, &cachecfg[ncachelevels]) < 0) {
+                usage();
+                exit(1);
+            }
+            ncachelevels++;
+            break;
+#endif
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -368,6 +430,18 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+#ifdef CACHESIM
+    /* by default a 32 KB, 8-way L1 with 64-byte lines */
+    if (ncachelevels == 0) {
+        cache_config_t l1 = { 6, 8, 6, -1, CACHE_NINE, 0 };
+        cachecfg[ncachelevels++] = l1;
+    }
+    cache_results = calloc(num_tracefiles * CACHE_MAXLEVEL,
+                           sizeof(cache_result_t));
+    if (cache_results == NULL)
+        unix_error("cache_results calloc in main failed");
+#endif
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -427,6 +501,13 @@ int main(int argc, char **argv)
     run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
               ranges, &speed_params);
 
+#ifdef CACHESIM
+    /* Only the misses are measured, the traced mm.c is not timed */
+    if (!onetime_flag) {
+        printcache(num_tracefiles, mm_stats);
+        exit(errors != 0);
+    }
+#endif
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -905,6 +986,10 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
                 r = r->next;
             }
         }
+        else if(debug_mode == DBG_INCREMENTAL) {
+            /* Let the students check a bounded part of their heap */
+            mm_checkheap_incremental(verbose);
+        }
 
         switch (trace->ops[i].type) {
 
@@ -1144,6 +1229,122 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+#ifdef CACHESIM
+/*
+ * cache_misses - the misses of every level of c so far
+ */
+static void cache_misses(cache_t *c, unsigned long *misses)
+{
+    cache_stats_t st;
+    int l;
+
+    for (l = 0; l < ncachelevels; l++) {
+        cache_stats(c, l, &st);
+        misses[l] = st.misses;
+    }
+}
+
+/*
+ * eval_mm_cache - Replay the trace through the cache model. The mm
+ *     package is the build in mm-traced.o, whose loads and stores to the
+ *     heap go into the cache through memtrace, so every header, footer
+ *     and free list pointer that find_fit, place and coalesce read or
+ *     write is counted. The driver stands in for the program around the
+ *     allocator: it writes the whole payload of every block it gets from
+ *     mm_malloc or mm_realloc and reads the whole payload before mm_free.
+ *     The copy in mm_realloc is done by memcpy, which is not traced, so
+ *     it is added to the allocator's accesses when the block moves.
+ */
+static void eval_mm_cache(trace_t *trace, int tracenum,
+                          cache_result_t *results)
+{
+    unsigned long before[CACHE_MAXLEVEL], during[CACHE_MAXLEVEL];
+    unsigned long after[CACHE_MAXLEVEL];
+    int i, l, type, index;
+    size_t size, oldsize;
+    char *p, *oldp;
+    cache_t *c;
+
+    if ((c = cache_create(cachecfg, ncachelevels, CACHE_LRU)) == NULL)
+        app_error("trace %d: wrong cache levels or out of memory in "
+                  "eval_mm_cache\n", tracenum);
+    reinit_trace(trace);
+
+    /* Reset the heap and trace all of it from mm_init on */
+    mem_reset_brk();
+    memtrace_attach(c, mem_heap_lo(), (char *)mem_heap_lo() + MAX_HEAP);
+    if (mm_init() < 0)
+        app_error("trace %d: mm_init failed in eval_mm_cache", tracenum);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        type = trace->ops[i].type;
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        cache_misses(c, before);
+
+        switch (type) {
+
+        case ALLOC: /* mm_malloc, then the program fills the block */
+            if ((p = mm_malloc(size)) == NULL)
+                app_error("trace %d: mm_malloc failed in eval_mm_cache",
+                          tracenum);
+            cache_misses(c, during);
+            cache_access(c, (unsigned long)p, size, CACHE_STORE);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case REALLOC: /* mm_realloc and its copy, then the fill */
+            oldp = trace->blocks[index];
+            oldsize = trace->block_sizes[index];
+            if ((p = mm_realloc(oldp, size)) == NULL && size != 0)
+                app_error("trace %d: mm_realloc failed in eval_mm_cache",
+                          tracenum);
+            if (p != NULL && p != oldp && oldp != NULL) {
+                size_t copied = oldsize < size ? oldsize : size;
+                cache_access(c, (unsigned long)oldp, copied, CACHE_LOAD);
+                cache_access(c, (unsigned long)p, copied, CACHE_STORE);
+            }
+            cache_misses(c, during);
+            if (p != NULL)
+                cache_access(c, (unsigned long)p, size, CACHE_STORE);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case FREE: /* the program reads the block one last time */
+            p = index < 0 ? NULL : trace->blocks[index];
+            if (p != NULL)
+                cache_access(c, (unsigned long)p,
+                             trace->block_sizes[index], CACHE_LOAD);
+            cache_misses(c, during);
+            mm_free(p);
+            break;
+
+        default:
+            app_error("trace %d: Nonexistent request type in eval_mm_cache",
+                      tracenum);
+        }
+
+        cache_misses(c, after);
+        for (l = 0; l < ncachelevels; l++) {
+            results[l].ops[type]++;
+            if (type == FREE) {
+                results[l].payload[type] += during[l] - before[l];
+                results[l].mm[type] += after[l] - during[l];
+            } else {
+                results[l].mm[type] += during[l] - before[l];
+                results[l].payload[type] += after[l] - during[l];
+            }
+        }
+    }
+
+    memtrace_detach();
+    cache_free(c);
+    printf(".");
+}
+#endif
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1372,6 +1573,70 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+#ifdef CACHESIM
+/*
+ * printcacherow - prints one row of printcache, "--" for request types
+ *     the trace does not have
+ */
+static void printcacherow(const char *valid, const cache_result_t *r,
+                          const char *name)
+{
+    unsigned long ops = 0, misses = 0, payload = 0;
+    int t;
+
+    printf("%5s", valid);
+    for (t = ALLOC; t <= REALLOC; t++) {
+        ops += r->ops[t];
+        misses += r->mm[t] + r->payload[t];
+        payload += r->payload[t];
+        if (r->ops[t] > 0)
+            printf("%9.2f", (double)r->mm[t] / r->ops[t]);
+        else
+            printf("%9s", "--");
+    }
+    if (ops > 0)
+        printf("%9.2f%9.2f", (double)payload / ops, (double)misses / ops);
+    else
+        printf("%9s%9s", "--", "--");
+    printf("  %s\n", name);
+}
+
+/*
+ * printcache - prints the misses per request of every trace, for each
+ *     cache level: those of the allocator itself for each request type,
+ *     then those of the payload touches and of everything together
+ */
+static void printcache(int n, stats_t *stats)
+{
+    cache_result_t sum;
+    const cache_result_t *r;
+    int i, l, t;
+
+    for (l = 0; l < ncachelevels; l++) {
+        printf("\nL%d misses per request (s=%u E=%u b=%u):\n", l + 1,
+               cachecfg[l].s, cachecfg[l].E, cachecfg[l].b);
+        printf("%5s%9s%9s%9s%9s%9s  %s\n", "valid", "malloc", "free",
+               "realloc", "payload", "total", "trace");
+        memset(&sum, 0, sizeof(sum));
+        for (i = 0; i < n; i++) {
+            if (!stats[i].valid) {
+                printf("%5s%9s%9s%9s%9s%9s  %s\n", "no", "-", "-", "-",
+                       "-", "-", stats[i].filename);
+                continue;
+            }
+            r = &cache_results[i * CACHE_MAXLEVEL + l];
+            printcacherow("yes", r, stats[i].filename);
+            for (t = ALLOC; t <= REALLOC; t++) {
+                sum.ops[t] += r->ops[t];
+                sum.mm[t] += r->mm[t];
+                sum.payload[t] += r->payload[t];
+            }
+        }
+        printcacherow("", &sum, "all traces");
+    }
+}
+#endif
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1417,10 +1682,11 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDI] [-f <file>]\n");
     fprintf(stderr, "Options\n");
-    fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
+    fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots; 3 incremental.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
+    fprintf(stderr, "\t-I         Equivalent to -d3.\n");
     fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for correctness only.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
@@ -1429,4 +1695,8 @@ static void usage(void)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+#ifdef CACHESIM
+    fprintf(stderr, "\t-L <spec>  Add a cache level, as in csim -L s,E,b[,...]\n");
+    fprintf(stderr, "\t           (default one level 6,8,6: 32 KB, 8-way, 64-byte lines).\n");
+#endif
 }
@@ -21,17 +21,35 @@
  * | size | alloc | next offset=32 bit | prev offset=32 bit | size | alloc |
  *
  * Freelist:
- * There are 8 free lists, each is corresponding to certain size.
- * In the prologue part, there are 8 bytes, each have two 4 bytes part.
+ * There are LISTNUM free lists, each is corresponding to certain size.
+ * The size classes are spelled out once in SIZE_CLASSES; LISTNUM and the
+ * size to list lookup table are generated from it at compile time.
+ * In the prologue part, there are 8 bytes per list, each have two 4 bytes part.
  * The first 4 bytes part contains the offset of first block in the list
  * The scond 4 bytes part is the prev pointer pointed to the head itself
  * When the new block is freed, it will be added to the first place LIFO policy
  * When a block is deleted, it only needs to redirect pointers of prev and next blocks
  *
  * 
+ * Calloc:
+ * clean_off marks the end of the highest block ever handed out (or the
+ * end of memory dirtied before the last heap reset: mem_reset_brk does
+ * not zero the heap, so heap_dirty keeps the highest brk across mm_init;
+ * after a fresh mem_init that only costs some needless clearing).
+ * Past it the heap holds only zeros and the live boundary tags and list
+ * pointers of free blocks; coalesce zeroes the tags and pointers it buries
+ * there. calloc then only clears the payload below clean_off plus the
+ * list pointers at the start of the block.
+ *
  * Debug:
  * Using the mm_heapcheck function to check all the environments
  * at that time, including heap check, block check, and list check
+ * mm_checkheap_incremental does the same work spread over many calls:
+ * each call sweeps at most CHECK_SLICE blocks and remembers where it
+ * stopped. Every free list keeps an xor hash of its members' offsets,
+ * updated in addblock/deleteblock, and the sweep rebuilds the same hash
+ * from the headers it sees. When a sweep reaches the epilogue the two
+ * hashes must agree, which catches blocks lost from or leaked into lists.
  */
 #include <assert.h>
 #include <stdio.h>
@@ -55,7 +73,51 @@
 #define WSIZE            4          /* Word and header/footer size (bytes) */
 #define DSIZE            8          /* Doubleword size (bytes) */
 #define CHUNKSIZE        (1 << 8)   /* Extend heap by this amount (bytes) */
-#define LISTNUM        8            /* Number of lists in segregate list*/
+#define CLASS_TABLE      64         /* Sizes covered by the lookup table,
+                                       a power of two from 16 to 256 */
+#define CHECK_SLICE      64         /* Blocks swept per incremental check */
+
+/*
+ * Size classes: each X(bound, arg) closes a list holding blocks of at
+ * most bound bytes, one more list takes everything larger. Retune the
+ * lists by editing this line only, bounds must be increasing and less
+ * than CLASS_TABLE * DSIZE.
+ */
+#define SIZE_CLASSES(X, arg) \
+    X(16, arg) X(32, arg) X(48, arg) X(64, arg) X(80, arg) X(128, arg) X(256, arg)
+
+/* Number of lists in segregate list */
+#define CLASS_COUNT(bound, arg)     + 1
+#define LISTNUM                     (1 SIZE_CLASSES(CLASS_COUNT, 0))
+
+/* List index of a block of size sz, as a constant expression */
+#define CLASS_ABOVE(bound, sz)      + ((sz) > (bound))
+#define CLASS_OF(sz)                (0 SIZE_CLASSES(CLASS_ABOVE, sz))
+
+/* Rows of the lookup table, entry n is the list of blocks of n*DSIZE bytes */
+#define CLASS_ROW1(n)       CLASS_OF((n) * DSIZE),
+#define CLASS_ROW4(n)       CLASS_ROW1(n) CLASS_ROW1(n+1) CLASS_ROW1(n+2) CLASS_ROW1(n+3)
+#define CLASS_ROW16(n)      CLASS_ROW4(n) CLASS_ROW4(n+4) CLASS_ROW4(n+8) CLASS_ROW4(n+12)
+#define CLASS_ROW64(n)      CLASS_ROW16(n) CLASS_ROW16(n+16) CLASS_ROW16(n+32) CLASS_ROW16(n+48)
+
+/* The whole table, CLASS_TABLE entries */
+#if CLASS_TABLE == 16
+#define CLASS_ROWS          CLASS_ROW16(0)
+#elif CLASS_TABLE == 32
+#define CLASS_ROWS          CLASS_ROW16(0) CLASS_ROW16(16)
+#elif CLASS_TABLE == 64
+#define CLASS_ROWS          CLASS_ROW64(0)
+#elif CLASS_TABLE == 128
+#define CLASS_ROWS          CLASS_ROW64(0) CLASS_ROW64(64)
+#elif CLASS_TABLE == 256
+#define CLASS_ROWS          CLASS_ROW64(0) CLASS_ROW64(64) CLASS_ROW64(128) CLASS_ROW64(192)
+#else
+#error "CLASS_TABLE must be 16, 32, 64, 128 or 256"
+#endif
+
+/* Fails to compile if a bound falls outside the lookup table */
+#define CLASS_FITS(bound, arg)      && ((bound) < CLASS_TABLE * DSIZE)
+extern char size_classes_fit_table[(1 SIZE_CLASSES(CLASS_FITS, 0)) ? 1 : -1];
 
 /* round up to the nearest multiple of ALIGNMENT */
 #define ALIGN(size) (((size_t)(size) + (7)) & ~0x7)
@@ -88,20 +150,36 @@
 #define NEXT_POS(bp)  (heap_star + (*(unsigned int *)(NEXT_PTR(bp))))
 #define PREV_POS(bp)  (heap_star + (*(unsigned int *)(PREV_PTR(bp))))
 
+/* Given list head address, compute its index; hash a block offset */
+#define LIST_INDEX(head)    ((size_t)((char *)(head) - heap_star) / DSIZE - 1)
+#define HASH_OFF(off)       ((unsigned int)(off) * 2654435761u)
+
 /* Global Variables */
 static char *heap_listp = NULL;     // heap start and then move to prologue
 static char *heap_star = NULL;      // heap start address
 static char *epilogue;              // epilogue part
+static size_t clean_off;            // heap is zero past here, but for tags
+static char *heap_dirty = NULL;     // highest brk ever, kept across mm_init
+
+/* List index for each block size below CLASS_TABLE * DSIZE */
+static const unsigned char size_class[CLASS_TABLE] = { CLASS_ROWS };
+
+/* Incremental checker state */
+static size_t check_off;                    // offset of next block to sweep
+static unsigned int list_hash[LISTNUM];     // hash of blocks in each list
+static unsigned int sweep_hash[LISTNUM];    // same hash, for swept blocks
 
 /* Function prototypes for internal helper routines */
 static void place(void *bp, size_t asize);
 static void *extend_heap(size_t words);
 static void *coalesce(void *bp);
+static inline void scrubjoint(void *bp);
 static void *find_fit(size_t asize);
 static inline char *chooselist(size_t asize);
 static inline void addblock(void *bp, char *free_list_head);
 static inline void deleteblock(void *bp);
 void mm_checkheap(int lineno);
+void mm_checkheap_incremental(int lineno);
 static size_t getprealloc(void* bp);
 
 /*
@@ -121,6 +199,10 @@ int mm_init(void)
     /* The basement of address */
     heap_star = heap_listp;
     
+    /* memory used before the last heap reset is not zero anymore */
+    heap_dirty = MAX(heap_dirty, (char *)mem_heap_hi() + 1);
+    clean_off = (size_t)heap_dirty - (size_t)heap_star;
+    
     PUT(heap_listp, 0);
     heap_listp += DSIZE;
     
@@ -141,6 +223,11 @@ int mm_init(void)
     epilogue = heap_star + prologue_size + WSIZE;
     PUT(epilogue, PACK(0, 1));
     
+    /* Incremental sweep starts at the first block, nothing seen yet */
+    check_off = prologue_size + DSIZE;
+    memset(list_hash, 0, sizeof(list_hash));
+    memset(sweep_hash, 0, sizeof(sweep_hash));
+    
     /* initial extend */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL) {
         return -1;
@@ -171,16 +258,18 @@ void *malloc(size_t size)
         asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
     
     /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        return bp;
+    if ((bp = find_fit(asize)) == NULL) {
+        
+        /* No fit found. Get more memory and place the block */
+        extendsize = MAX(asize,CHUNKSIZE);
+        if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+            return NULL;
     }
-    
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-        return NULL;
     place(bp, asize);
+    
+    /* the user may write anywhere in the block from now on */
+    size_t end = (size_t)bp - (size_t)heap_star + GET_SIZE(HDRP(bp));
+    clean_off = MAX(clean_off, end);
     return bp;
 }
 
@@ -264,31 +353,19 @@ static void *find_fit(size_t asize)
 
 /*
  * chooselist - Helper function that choose the head of list 
- * corresponding to certain size
- * 
+ * corresponding to certain size, small sizes are one table lookup
+ * and everything past the table goes to the last list
  */
 static inline char *chooselist(size_t asize)
 {
-    size_t offset;
-    if (asize <= 16)
-        offset = 1;
-    else if (asize>16 && asize <= 32)
-        offset = 2;
-    else if (asize>32 && asize <= 48)
-        offset = 3;
-    else if (asize>48 && asize <= 64)
-        offset = 4;
-    else if (asize>64 && asize <= 80)
-        offset = 5;
-    else if (asize>80 && asize <= 128)
-        offset = 6;
-    else if (asize>128 && asize <= 256)
-        offset = 7;
+    size_t index;
+    if (asize < CLASS_TABLE * DSIZE)
+        index = size_class[asize / DSIZE];
     else
-        offset = 8;
+        index = LISTNUM - 1;
     
     /* return the header address */
-    return heap_star + (offset * DSIZE);
+    return heap_star + ((index + 1) * DSIZE);
 }
 
 
@@ -306,6 +383,12 @@ static inline void addblock(void *bp, char *head)
     /* make head point to this block */
     PUT(NEXT_PTR(head), offset);
     PUT(PREV_PTR(NEXT_POS(bp)), offset);
+    
+    /* record membership, also for the sweep if it already passed here */
+    size_t index = LIST_INDEX(head);
+    list_hash[index] ^= HASH_OFF(offset);
+    if (offset < check_off)
+        sweep_hash[index] ^= HASH_OFF(offset);
 }
 
 /*
@@ -316,6 +399,13 @@ static inline void deleteblock(void *bp)
     /* change the pointer of pre and next block*/
     PUT(NEXT_PTR(PREV_POS(bp)), GET(NEXT_PTR(bp)));
     PUT(PREV_PTR(NEXT_POS(bp)), GET(PREV_PTR(bp)));
+    
+    /* drop membership, the header still holds the size it was added with */
+    size_t offset = (size_t)bp - (size_t)heap_star;
+    size_t index = LIST_INDEX(chooselist(GET_SIZE(HDRP(bp))));
+    list_hash[index] ^= HASH_OFF(offset);
+    if (offset < check_off)
+        sweep_hash[index] ^= HASH_OFF(offset);
 }
 
 /*
@@ -365,12 +455,14 @@ static void *extend_heap(size_t words)
     size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
     if ((long)(bp = mem_sbrk(size)) == -1)
         return NULL;
+    heap_dirty = MAX(heap_dirty, (char *)mem_heap_hi() + 1);
     
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
     
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    epilogue = HDRP(NEXT_BLKP(bp));
     
     /* Coalesce if the previous block was free */
     return coalesce(bp);
@@ -418,6 +510,7 @@ static void *coalesce(void *bp)
         /* extend size and repack the header footer information*/
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         deleteblock(NEXT_BLKP(bp));
+        scrubjoint(NEXT_BLKP(bp));
         
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size,0));
@@ -435,7 +528,10 @@ static void *coalesce(void *bp)
         
         PUT(HDRP(PREV_BLKP(bp)),PACK(size,  0));
         PUT(FTRP(bp), PACK(size,  0));
-        bp = PREV_BLKP(bp);
+        
+        char *prev = PREV_BLKP(bp);
+        scrubjoint(bp);
+        bp = prev;
     }
     
     /*
@@ -452,10 +548,18 @@ static void *coalesce(void *bp)
         PUT(HDRP(PREV_BLKP(bp)),PACK(size,  0));
         PUT(FTRP(NEXT_BLKP(bp)),PACK(size,  0));
         
-        bp = PREV_BLKP(bp);
-        
+        char *prev = PREV_BLKP(bp);
+        scrubjoint(NEXT_BLKP(bp));
+        scrubjoint(bp);
+        bp = prev;
     }
   
+    /* the sweep cursor may now point inside the merged block, */
+    /* move it back so the merged block is swept as a whole */
+    size_t offset = (size_t)bp - (size_t)heap_star;
+    if (offset < check_off && check_off < offset + size)
+        check_off = offset;
+    
     /* insert new free block to free list */
     char *list = chooselist(size);
     addblock(bp, list);
@@ -464,16 +568,42 @@ static void *coalesce(void *bp)
 }
 
 /*
- * calloc - Allocate the block and set it to zero.
+ * scrubjoint - Zero the footer, header and list pointers that are left
+ *              inside a merged free block at the joint before bp, if they
+ *              reach into the clean part of the heap
+ */
+static inline void scrubjoint(void *bp)
+{
+    if ((size_t)bp - (size_t)heap_star + DSIZE > clean_off) {
+        PUT((char *)bp - DSIZE, 0);
+        PUT(HDRP(bp), 0);
+        PUT(NEXT_PTR(bp), 0);
+        PUT(PREV_PTR(bp), 0);
+    }
+}
+
+/*
+ * calloc - Allocate the block and set it to zero. Only the part below
+ *          clean_off and the old list pointers need clearing.
  */
 void *calloc (size_t nmemb, size_t size)
 {
     size_t bytes = nmemb * size;
-    void *newptr;
+    size_t clean = clean_off;
+    size_t dirty;
+    char *newptr;
+    
+    if ((newptr = malloc(bytes)) == NULL)
+        return NULL;
     
-    newptr = malloc(bytes);
-    memset(newptr, 0, bytes);
+    /* bytes of the payload that may not be zero */
+    dirty = (size_t)newptr - (size_t)heap_star;
+    dirty = (clean > dirty) ? clean - dirty : 0;
+    dirty = MAX(dirty, DSIZE);
+    if (dirty > bytes)
+        dirty = bytes;
     
+    memset(newptr, 0, dirty);
     return newptr;
 }
 
@@ -667,3 +797,59 @@ void mm_checkheap(int lineno)
 
 }
 
+
+/*
+ * mm_checkheap_incremental - Check at most CHECK_SLICE blocks of the heap,
+ *                            continuing from where the last call stopped.
+ *                            When the sweep reaches the epilogue, compare
+ *                            the free list hashes and start over.
+ */
+void mm_checkheap_incremental(int lineno)
+{
+    char *bp = heap_star + check_off;
+    size_t i;
+    
+    /* check prologue and epilogue, both are constant time */
+    if (GET_SIZE(HDRP(heap_listp)) != LISTNUM * DSIZE + DSIZE ||
+        !GET_ALLOC(HDRP(heap_listp))) {
+        printf("Error: line %d: %p prologue corrupted\n", lineno, heap_listp);
+    }
+    if (GET_SIZE(epilogue) != 0 || !GET_ALLOC(epilogue)) {
+        printf("Error: line %d: %p epilogue corrupted\n", lineno, epilogue);
+    }
+    
+    /* sweep one slice of blocks */
+    for (i = 0; i < CHECK_SLICE && GET_SIZE(HDRP(bp)) != 0; i++) {
+        checkoneblock(bp);
+        
+        if (!GET_ALLOC(HDRP(bp))) {
+            size_t offset = (size_t)bp - (size_t)heap_star;
+            
+            if (!getprealloc(bp)) {
+                printf("Error: line %d: %p has consecutive block, need coalesce\n",
+                       lineno, bp);
+            }
+            
+            /* check prev and next ptr consistency */
+            if (bp != PREV_POS(NEXT_POS(bp)) || bp != NEXT_POS(PREV_POS(bp))) {
+                printf("Error: line %d: %p the free block prev next pointer mismatch\n",
+                       lineno, bp);
+            }
+            sweep_hash[LIST_INDEX(chooselist(GET_SIZE(HDRP(bp))))] ^= HASH_OFF(offset);
+        }
+        bp = NEXT_BLKP(bp);
+    }
+    check_off = (size_t)bp - (size_t)heap_star;
+    
+    /* reached the epilogue, the sweep has seen every free block */
+    if (GET_SIZE(HDRP(bp)) == 0) {
+        for (i = 0; i < LISTNUM; i++) {
+            if (sweep_hash[i] != list_hash[i]) {
+                printf("Error: line %d: free list %zu does not match the heap\n",
+                       lineno, i);
+            }
+        }
+        check_off = (size_t)NEXT_BLKP(heap_listp) - (size_t)heap_star;
+        memset(sweep_hash, 0, sizeof(sweep_hash));
+    }
+}
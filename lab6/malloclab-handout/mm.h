@@ -22,3 +22,4 @@ extern int mm_init(void);
 
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
+extern void mm_checkheap_incremental(int lineno);